@@ -2,12 +2,24 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <sys/time.h>
-#include "myMalloc-helper.h"
+#include <pthread.h>
+#include <unistd.h>
+#include "myMalloc.h"
+#include "myMalloc-pages.h"
+#include "myMalloc-buddy.h"
 
-int myInit(int numCores, int flag);
-void *myMalloc(int size);
-void myFree(void *ptr);
+int checksFailed = 0;
+
+void check(int ok, const char *what) {
+    if (ok) {
+        printf("%s passed.\n", what);
+    } else {
+        printf("%s failed!\n", what);
+        checksFailed++;
+    }
+}
 
 int verifyPattern(unsigned char *ptr, int size, unsigned char pattern) {
     for (int i = 0; i < size; i++) {
@@ -69,14 +81,859 @@ void testMyMalloc() {
     }
 }
 
+// --- Size Class Test ---
+// every request up to 1024 bytes gets the smallest class that holds it, and no class is
+// more than 16 bytes or 25% bigger than the one below it
+void testSizeClasses() {
+    int size, block, below = 0, ok = 1;
+
+    printf("\nTesting size classes...\n");
+    if (myInit(1, 0) != 0) {
+        printf("Memory initialization failed.\n");
+        return;
+    }
+    for (size = 1; size <= 1024; size++) {
+        char *a = myMalloc(size), *b = myMalloc(size);
+        if (!a || !b) {
+            ok = 0;
+            break;
+        }
+        // a slab hands out its blocks back to back, so these are a block size apart
+        block = (a < b) ? b - a : a - b;
+        myFree(b);
+        myFree(a);
+        if (block < size) ok = 0;
+        if (block != below) {
+            // the next class up: the one below it must have been too small for this size
+            if (below >= size || (block - below > 16 && 4 * (block - below) > below)) ok = 0;
+            below = block;
+        }
+    }
+    check(ok, "Size classes");
+}
+
+// --- Page Heap Test ---
+// spans above 16 KB come from the page heap and coalesce when freed; a second free of a
+// large or huge block is reported and must not hand the same pages out twice
+void testPageHeap() {
+    myMallocStatistics stats;
+    long frees;
+
+    printf("\nTesting the page heap...\n");
+    if (myInit(1, 0) != 0) {
+        printf("Memory initialization failed.\n");
+        return;
+    }
+    char *a = myMalloc(64 * 1024), *b = myMalloc(64 * 1024), *c = myMalloc(64 * 1024);
+    check(a && b && c, "Large blocks");
+    memset(b, 0xCC, 64 * 1024);
+    check(verifyPattern((unsigned char *) b, 64 * 1024, 0xCC), "Large block memory");
+    myFree(b);
+    myFree(a);
+    myFree(c);
+    // the three spans coalesced, so one block of all three fits where they were
+    char *abc = myMalloc(192 * 1024);
+    check(abc != NULL, "Coalesced large block");
+    myFree(abc);
+
+    a = myMalloc(64 * 1024);
+    myFree(a);
+    myMallocStats(&stats);
+    frees = stats.frees;
+    myFree(a);
+    myMallocStats(&stats);
+    b = myMalloc(64 * 1024);
+    c = myMalloc(64 * 1024);
+    check(stats.frees == frees && b != c, "Large block double free");
+    myFree(b);
+    myFree(c);
+
+    a = myMalloc(4 << 20);
+    check(a != NULL, "Huge block");
+    myFree(a);
+    myFree(a);
+    b = myMalloc(4 << 20);
+    c = myMalloc(4 << 20);
+    check(b && c && b != c, "Huge block double free");
+    myFree(b);
+    myFree(c);
+}
+
+// --- Slab Map Test ---
+// slab blocks carry no header: any byte of a block, on any page of its slab, leads back to
+// the slab through the page map, and memory the page heap did not hand out leads nowhere
+#define SLAB_BLOCKS 400
+
+void testSlabMap() {
+    char *blocks[SLAB_BLOCKS];
+    int local, i, ok = 1;
+
+    printf("\nTesting the slab page map...\n");
+    if (myInit(1, 0) != 0) {
+        printf("Memory initialization failed.\n");
+        return;
+    }
+    // 48-byte blocks, 170 to a two-page slab
+    for (i = 0; i < SLAB_BLOCKS; i++) {
+        blocks[i] = myMalloc(48);
+        span *s = blocks[i] ? spanOf(blocks[i]) : NULL;
+        if (!s || s->kind != SPAN_SLAB || spanOf(blocks[i] + 47) != s || blocks[i] < s->start ||
+            blocks[i] + 48 > s->start + s->pages * PAGE_BYTES || (blocks[i] - s->start) % 48 != 0) {
+            ok = 0;
+        }
+    }
+    check(ok, "Slab blocks in the page map");
+    check(spanOf(&local) == NULL, "Memory outside the page heap");
+    for (i = 0; i < SLAB_BLOCKS; i++) {
+        myFree(blocks[i]);
+    }
+}
+
+// --- LIFO Test ---
+// free blocks sit on a stack per class, so the block freed last is the first handed out
+void testLifo() {
+    char *a, *b, *c, *x, *y, *z;
+
+    printf("\nTesting LIFO reuse...\n");
+    if (myInit(1, 0) != 0) {
+        printf("Memory initialization failed.\n");
+        return;
+    }
+    a = myMalloc(100);
+    b = myMalloc(100);
+    c = myMalloc(100);
+    myFree(a);
+    myFree(c);
+    myFree(b);
+    x = myMalloc(100);
+    y = myMalloc(100);
+    z = myMalloc(100);
+    check(x == b && y == c && z == a, "LIFO reuse");
+    myFree(x);
+    myFree(y);
+    myFree(z);
+}
+
+// --- Thread Exit Test ---
+// a thread that exits leaves its heap to the next new thread
+#define EXIT_BLOCKS 500
+
+void *exitedBlocks[EXIT_BLOCKS];
+void *reusedOwner;
+
+int comparePointers(const void *a, const void *b) {
+    uintptr_t x = (uintptr_t) *(void **) a, y = (uintptr_t) *(void **) b;
+    return (x > y) - (x < y);
+}
+
+void *exitWorker(void *arg) {
+    int i;
+    for (i = 0; i < EXIT_BLOCKS; i++) {
+        exitedBlocks[i] = myMalloc(64);
+    }
+    return NULL;
+}
+
+// a class the exited thread never used, so the block comes from a new slab of the heap
+void *reuseWorker(void *arg) {
+    void *p = myMalloc(16);
+    reusedOwner = spanOf(p)->owner;
+    myFree(p);
+    return NULL;
+}
+
+void testThreadExit() {
+    pthread_t thread;
+
+    printf("\nTesting thread exit...\n");
+    if (myInit(2, 2) != 0) {
+        printf("Memory initialization failed.\n");
+        return;
+    }
+    pthread_create(&thread, NULL, exitWorker, NULL);
+    pthread_join(thread, NULL);
+    pthread_create(&thread, NULL, reuseWorker, NULL);
+    pthread_join(thread, NULL);
+    check(reusedOwner == spanOf(exitedBlocks[0])->owner, "Heap reuse after thread exit");
+}
+
+// --- Remote Free Test ---
+// blocks freed by another thread go on their owner's remote-free queue, not on the freeing
+// thread's lists, and the owner takes them back on its next miss
+#define REMOTE_BLOCKS 200
+
+void *remoteBlocks[REMOTE_BLOCKS];
+pthread_barrier_t remoteBarrier;
+int remoteFound = 0;
+
+void *ownerWorker(void *arg) {
+    void *blocks[2 * REMOTE_BLOCKS];
+    int i;
+
+    for (i = 0; i < REMOTE_BLOCKS; i++) {
+        remoteBlocks[i] = myMalloc(64);
+    }
+    pthread_barrier_wait(&remoteBarrier);
+    // the other thread frees them meanwhile; the rest of this heap's slab comes first
+    pthread_barrier_wait(&remoteBarrier);
+    for (i = 0; i < 2 * REMOTE_BLOCKS; i++) {
+        blocks[i] = myMalloc(64);
+        remoteFound += bsearch(&blocks[i], remoteBlocks, REMOTE_BLOCKS, sizeof(void *), comparePointers) != NULL;
+    }
+    for (i = 0; i < 2 * REMOTE_BLOCKS; i++) {
+        myFree(blocks[i]);
+    }
+    return NULL;
+}
+
+void testRemoteFree() {
+    pthread_t thread;
+    void *blocks[REMOTE_BLOCKS];
+    int i, found = 0;
+
+    printf("\nTesting remote frees...\n");
+    if (myInit(2, 2) != 0) {
+        printf("Memory initialization failed.\n");
+        return;
+    }
+    pthread_barrier_init(&remoteBarrier, NULL, 2);
+    pthread_create(&thread, NULL, ownerWorker, NULL);
+    pthread_barrier_wait(&remoteBarrier);
+    qsort(remoteBlocks, REMOTE_BLOCKS, sizeof(void *), comparePointers);
+    for (i = 0; i < REMOTE_BLOCKS; i++) {
+        myFree(remoteBlocks[i]);
+    }
+    for (i = 0; i < REMOTE_BLOCKS; i++) {
+        blocks[i] = myMalloc(64);
+        found += bsearch(&blocks[i], remoteBlocks, REMOTE_BLOCKS, sizeof(void *), comparePointers) != NULL;
+    }
+    check(found == 0, "Remote frees kept off the freeing heap");
+    pthread_barrier_wait(&remoteBarrier);
+    pthread_join(thread, NULL);
+    pthread_barrier_destroy(&remoteBarrier);
+    check(remoteFound == REMOTE_BLOCKS, "Remote frees drained by their owner");
+    for (i = 0; i < REMOTE_BLOCKS; i++) {
+        myFree(blocks[i]);
+    }
+}
+
+// --- Exited Heap Test ---
+// blocks freed to the heap of a thread that has exited go on to the overflow pool, where
+// other threads can have them
+void testExitedHeap() {
+    myMallocStatistics stats;
+    pthread_t thread;
+    void *blocks[EXIT_BLOCKS];
+    int i, reused = 0;
+
+    printf("\nTesting frees to an exited thread's heap...\n");
+    if (myInit(2, 2) != 0) {
+        printf("Memory initialization failed.\n");
+        return;
+    }
+    myFree(myMalloc(16));
+    pthread_create(&thread, NULL, exitWorker, NULL);
+    pthread_join(thread, NULL);
+    for (i = 0; i < EXIT_BLOCKS; i++) {
+        myFree(exitedBlocks[i]);
+    }
+    myMallocStats(&stats);
+    check(stats.remoteFrees == EXIT_BLOCKS, "Remote frees");
+
+    // this thread's 64-byte class is empty, so these come from the overflow pool
+    qsort(exitedBlocks, EXIT_BLOCKS, sizeof(void *), comparePointers);
+    for (i = 0; i < EXIT_BLOCKS; i++) {
+        blocks[i] = myMalloc(64);
+        reused += bsearch(&blocks[i], exitedBlocks, EXIT_BLOCKS, sizeof(void *), comparePointers) != NULL;
+    }
+    check(reused == EXIT_BLOCKS, "Blocks freed to an exited thread's heap");
+    for (i = 0; i < EXIT_BLOCKS; i++) {
+        myFree(blocks[i]);
+    }
+}
+
+// --- Overflow Test ---
+// thread heaps limited to one slab per class spill into the overflow pool, in both its
+// lock-free and its locked form, and blocks pass through it intact
+#define OVERFLOW_THREADS 4
+#define OVERFLOW_BLOCKS 600
+
+volatile int overflowOk = 1;
+
+void *overflowWorker(void *arg) {
+    int id = *((int *) arg), round, i;
+    long *blocks[OVERFLOW_BLOCKS];
+
+    for (round = 0; round < 20; round++) {
+        for (i = 0; i < OVERFLOW_BLOCKS; i++) {
+            blocks[i] = myMalloc(sizeof(long));
+            if (!blocks[i]) {
+                overflowOk = 0;
+                return NULL;
+            }
+            *blocks[i] = id * OVERFLOW_BLOCKS + i;
+        }
+        for (i = 0; i < OVERFLOW_BLOCKS; i++) {
+            if (*blocks[i] != id * OVERFLOW_BLOCKS + i) overflowOk = 0;
+            myFree(blocks[i]);
+        }
+    }
+    return NULL;
+}
+
+void testOverflow(int locked) {
+    myMallocConfig config = {8192, 8192, 0, locked};
+    myMallocStatistics stats;
+    pthread_t threads[OVERFLOW_THREADS];
+    int ids[OVERFLOW_THREADS], i;
+    long ops, retries;
+
+    printf("\nTesting the %s overflow pool...\n", locked ? "locked" : "lock-free");
+    if (myInitWithConfig(OVERFLOW_THREADS, 2, &config) != 0) {
+        printf("Memory initialization failed.\n");
+        return;
+    }
+    overflowOk = 1;
+    for (i = 0; i < OVERFLOW_THREADS; i++) {
+        ids[i] = i;
+        pthread_create(&threads[i], NULL, overflowWorker, &ids[i]);
+    }
+    for (i = 0; i < OVERFLOW_THREADS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    check(overflowOk, "Blocks through the overflow pool");
+    myMallocStats(&stats);
+    myMallocOverflowContention(&ops, &retries);
+    check(stats.overflowHits > 0 && ops > 0 && stats.frees == stats.allocs, "Overflow pool use");
+}
+
+// --- Batch Refill Test ---
+// a heap past its high-water mark gives the older half of a class back to the overflow
+// pool as one batch, and another heap refills from those a batch, not a block, at a time.
+// A class that runs dry soon after each refill takes bigger batches, and holds more blocks
+// before it gives any back
+#define REFILL_BLOCKS 300
+#define REFILL_TAKEN 128
+#define REFILL_BIG 200
+
+void *refillBlocks[REFILL_BLOCKS];
+long refillOps;
+int refillFound = 0;
+
+void *refillWorker(void *arg) {
+    void *blocks[REFILL_TAKEN];
+    long before, after, retries;
+    int i;
+
+    myMallocOverflowContention(&before, &retries);
+    for (i = 0; i < REFILL_TAKEN; i++) {
+        blocks[i] = myMalloc(64);
+        refillFound += bsearch(&blocks[i], refillBlocks, REFILL_BLOCKS, sizeof(void *), comparePointers) != NULL;
+    }
+    myMallocOverflowContention(&after, &retries);
+    refillOps = after - before;
+    for (i = 0; i < REFILL_TAKEN; i++) {
+        myFree(blocks[i]);
+    }
+    return NULL;
+}
+
+void testBatchRefill() {
+    pthread_t thread;
+    void *big[REFILL_BIG];
+    long before, after, retries;
+    int i;
+
+    printf("\nTesting batch refills...\n");
+    if (myInit(2, 2) != 0) {
+        printf("Memory initialization failed.\n");
+        return;
+    }
+    for (i = 0; i < REFILL_BLOCKS; i++) {
+        refillBlocks[i] = myMalloc(64);
+    }
+    qsort(refillBlocks, REFILL_BLOCKS, sizeof(void *), comparePointers);
+    myMallocOverflowContention(&before, &retries);
+    for (i = 0; i < REFILL_BLOCKS; i++) {
+        myFree(refillBlocks[i]);
+    }
+    myMallocOverflowContention(&after, &retries);
+    check(after > before && after - before <= REFILL_BLOCKS / 32, "High-water release");
+
+    pthread_create(&thread, NULL, refillWorker, NULL);
+    pthread_join(thread, NULL);
+    check(refillFound == REFILL_TAKEN && refillOps > 0 && refillOps <= REFILL_TAKEN / 32, "Batch refill");
+
+    // 1024-byte blocks come eight to a slab, so this class runs dry every eight blocks
+    for (i = 0; i < REFILL_BIG; i++) {
+        big[i] = myMalloc(1024);
+    }
+    myMallocOverflowContention(&before, &retries);
+    for (i = 0; i < REFILL_BIG; i++) {
+        myFree(big[i]);
+    }
+    myMallocOverflowContention(&after, &retries);
+    check(after == before, "Adaptive batch size");
+}
+
+// --- Statistics Test ---
+// a heap starts on a cache line; the dump thread writes one report per call, plus one
+// per interval, and is gone as soon as a call stops it
+int countReports(const char *path) {
+    char line[256];
+    int reports = 0;
+    FILE *fp = fopen(path, "r");
+    if (!fp) return -1;
+    while (fgets(line, sizeof(line), fp)) {
+        if (strncmp(line, "heaps ", 6) == 0) reports++;
+    }
+    fclose(fp);
+    return reports;
+}
+
+void testStatsDump() {
+    const char *path = "/tmp/mmTest-stats.txt";
+    struct timeval start, end;
+    double stopTime;
+
+    printf("\nTesting statistics...\n");
+    if (myInit(1, 2) != 0) {
+        printf("Memory initialization failed.\n");
+        return;
+    }
+    void *p = myMalloc(64);
+    check(((size_t) spanOf(p)->owner % 64) == 0, "Heap alignment");
+    myFree(p);
+
+    remove(path);
+    myMallocStatsDump(path, 1);
+    sleep(2);
+    gettimeofday(&start, NULL);
+    myMallocStatsDump(path, 0);
+    gettimeofday(&end, NULL);
+    stopTime = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1000000.0;
+    int reports = countReports(path);
+    check(reports >= 2 && stopTime < 0.5, "Periodic statistics dump");
+    sleep(2);
+    check(countReports(path) == reports, "Statistics dump stop");
+    remove(path);
+}
+
+// --- Statistics Totals Test ---
+// with blocks of every tier allocated on one thread and freed on another, the totals
+// match the sums over classes and over heaps, and nothing is left in use at the end
+#define TOTALS_BLOCKS 300
+
+void *totalsBlocks[TOTALS_BLOCKS];
+
+void *totalsWorker(void *arg) {
+    int i;
+    for (i = 0; i < TOTALS_BLOCKS; i++) {
+        totalsBlocks[i] = myMalloc((i % 3 == 0) ? 40 : (i % 3 == 1) ? 3000 : 40000);
+    }
+    return NULL;
+}
+
+void testStatsTotals() {
+    myMallocStatistics stats, heap;
+    pthread_t thread;
+    long allocs = 0, frees = 0, heapAllocs = 0, heapFrees = 0;
+    int i, c;
+
+    printf("\nTesting statistics totals...\n");
+    if (myInit(2, 2) != 0) {
+        printf("Memory initialization failed.\n");
+        return;
+    }
+    pthread_create(&thread, NULL, totalsWorker, NULL);
+    pthread_join(thread, NULL);
+    for (i = 0; i < TOTALS_BLOCKS; i += 2) {
+        myFree(totalsBlocks[i]);
+    }
+    myMallocStats(&stats);
+    for (c = 0; c < MYMALLOC_STAT_CLASSES; c++) {
+        allocs += stats.classes[c].allocs;
+        frees += stats.classes[c].frees;
+    }
+    for (i = 0; myMallocThreadStats(i, &heap) == 0; i++) {
+        heapAllocs += heap.allocs;
+        heapFrees += heap.frees;
+    }
+    check(stats.allocs == TOTALS_BLOCKS && stats.frees == TOTALS_BLOCKS / 2 && allocs == stats.allocs &&
+          frees == stats.frees && heapAllocs == stats.allocs && heapFrees == stats.frees && i == stats.threadHeaps,
+          "Statistics totals");
+    check(stats.bytesInUse > 0 && stats.bytesInUse <= stats.heapBytes, "Bytes in use");
+
+    for (i = 1; i < TOTALS_BLOCKS; i += 2) {
+        myFree(totalsBlocks[i]);
+    }
+    myMallocStats(&stats);
+    check(stats.frees == stats.allocs && stats.bytesInUse == 0, "Statistics after every free");
+}
+
+// --- Fast Path Test ---
+// once a thread has a heap, myMalloc and myFree pop and push blocks of its cache inline
+// and keep the cache's counts; coarse mode gives threads no cache, so every call takes
+// the slow path to the overflow pool
+void testFastPath() {
+    myMallocCache *cache;
+    chunk *top;
+    void *p;
+    long allocs, frees;
+    int c, count, ok;
+
+    printf("\nTesting the inline fast paths...\n");
+    if (myInit(1, 2) != 0) {
+        printf("Memory initialization failed.\n");
+        return;
+    }
+    myFree(myMalloc(64));
+    cache = myMallocThreadCache;
+    check(cache != NULL, "Thread cache");
+    if (!cache) return;
+    c = myMallocSizeClass[(64 + 15) >> 4];
+    top = cache->freeList[c]->next;
+    count = cache->freeCount[c];
+    allocs = cache->allocs[c];
+    frees = cache->frees[c];
+    p = myMallocInline(64);
+    ok = p == top && cache->freeCount[c] == count - 1 && cache->allocs[c] == allocs + 1;
+    myFreeInline(p);
+    ok &= cache->freeList[c]->next == p && cache->freeCount[c] == count && cache->frees[c] == frees + 1;
+    check(ok, "Inline malloc and free");
+
+    if (myInit(1, 1) != 0) {
+        printf("Memory initialization failed.\n");
+        return;
+    }
+    p = myMalloc(64);
+    check(p != NULL && myMallocThreadCache == NULL, "No thread cache in coarse mode");
+    myFree(p);
+}
+
+// --- Per-CPU Test ---
+// threads in per-CPU mode (flag 3) allocate, fill and free blocks of every class
+#define CPU_THREADS 4
+#define CPU_ROUNDS 200
+#define CPU_BLOCKS 64
+
+volatile int cpuOk = 1;
+
+void *cpuWorker(void *arg) {
+    int id = *((int *) arg), round, i;
+    unsigned char *blocks[CPU_BLOCKS];
+    int sizes[CPU_BLOCKS];
+    unsigned int seed = id + 1;
+
+    for (round = 0; round < CPU_ROUNDS; round++) {
+        for (i = 0; i < CPU_BLOCKS; i++) {
+            sizes[i] = rand_r(&seed) % 1024 + 1;
+            blocks[i] = myMalloc(sizes[i]);
+            if (!blocks[i]) {
+                cpuOk = 0;
+                return NULL;
+            }
+            memset(blocks[i], (id + i) & 0xFF, sizes[i]);
+        }
+        for (i = 0; i < CPU_BLOCKS; i++) {
+            if (!verifyPattern(blocks[i], sizes[i], (id + i) & 0xFF)) cpuOk = 0;
+            myFree(blocks[i]);
+        }
+    }
+    return NULL;
+}
+
+void testPerCpu() {
+    myMallocStatistics stats;
+    pthread_t threads[CPU_THREADS];
+    int ids[CPU_THREADS], i;
+
+    printf("\nTesting per-CPU mode...\n");
+    if (myInit(CPU_THREADS, 3) != 0) {
+        printf("Memory initialization failed.\n");
+        return;
+    }
+    for (i = 0; i < CPU_THREADS; i++) {
+        ids[i] = i;
+        pthread_create(&threads[i], NULL, cpuWorker, &ids[i]);
+    }
+    for (i = 0; i < CPU_THREADS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    check(cpuOk, "Per-CPU blocks");
+    myMallocStats(&stats);
+    check(stats.allocs == (long) CPU_THREADS * CPU_ROUNDS * CPU_BLOCKS && stats.frees == stats.allocs,
+          "Per-CPU mallocs and frees");
+}
+
+// --- Batch Test ---
+// a batch of 256 blocks is 256 distinct, usable blocks; another thread frees them as a
+// batch, with NULL entries skipped, and they all come back. In coarse mode every free
+// pushes a single block on the overflow pool, and a batch takes all of those at once,
+// keeps what it needs and hands the rest back in one more operation
+#define BATCH_COUNT 256
+
+void *batchBlocks[BATCH_COUNT];
+
+void *batchFreeWorker(void *arg) {
+    myFreeBatch(batchBlocks, BATCH_COUNT);
+    return NULL;
+}
+
+void testBatch() {
+    myMallocStatistics stats;
+    pthread_t thread;
+    void *sorted[BATCH_COUNT], *singles[2 * BATCH_COUNT];
+    long before, after, retries;
+    int i, got, ok = 1;
+
+    printf("\nTesting batches...\n");
+    if (myInit(2, 2) != 0) {
+        printf("Memory initialization failed.\n");
+        return;
+    }
+    got = myMallocBatch(96, BATCH_COUNT, batchBlocks);
+    check(got == BATCH_COUNT, "Batch of 256");
+    for (i = 0; i < got; i++) {
+        if (!batchBlocks[i]) ok = 0;
+        else memset(batchBlocks[i], i & 0xFF, 96);
+    }
+    memcpy(sorted, batchBlocks, sizeof(sorted));
+    qsort(sorted, got, sizeof(void *), comparePointers);
+    for (i = 1; i < got; i++) {
+        if (sorted[i] == sorted[i - 1]) ok = 0;
+    }
+    for (i = 0; i < got; i++) {
+        if (batchBlocks[i] && !verifyPattern(batchBlocks[i], 96, i & 0xFF)) ok = 0;
+    }
+    check(ok, "Batch blocks");
+
+    // the last one goes on its own, so the batch has a hole
+    myFree(batchBlocks[BATCH_COUNT - 1]);
+    batchBlocks[BATCH_COUNT - 1] = NULL;
+    pthread_create(&thread, NULL, batchFreeWorker, NULL);
+    pthread_join(thread, NULL);
+    myMallocStats(&stats);
+    check(stats.allocs == BATCH_COUNT && stats.frees == BATCH_COUNT && stats.remoteFrees == BATCH_COUNT - 1,
+          "Batch free from another thread");
+
+    // 512 blocks of 96 bytes fill six slabs and break up the batch of a seventh, so every
+    // free block is a single one
+    if (myInit(1, 1) != 0) {
+        printf("Memory initialization failed.\n");
+        return;
+    }
+    for (i = 0; i < 2 * BATCH_COUNT; i++) {
+        singles[i] = myMalloc(96);
+    }
+    for (i = 0; i < 2 * BATCH_COUNT; i++) {
+        myFree(singles[i]);
+    }
+    myMallocOverflowContention(&before, &retries);
+    got = myMallocBatch(96, BATCH_COUNT, batchBlocks);
+    myMallocOverflowContention(&after, &retries);
+    check(got == BATCH_COUNT && after - before <= 3, "Batch from single blocks");
+    myFreeBatch(batchBlocks, got);
+}
+
+// --- Pool Test ---
+// threads allocate from one pool and free each other's objects; myFree must turn away a
+// pool object anywhere in its slab, not just on the slab's first page
+#define POOL_THREADS 4
+#define POOL_OBJECTS 1000
+#define POOL_OBJECT_SIZE 200
+
+myPool *sharedPool;
+void *poolObjects[POOL_THREADS][POOL_OBJECTS];
+pthread_barrier_t poolBarrier;
+volatile int poolOk = 1;
+
+void constructObject(void *object) {
+    memset(object, 0x5A, POOL_OBJECT_SIZE);
+}
+
+void *poolWorker(void *arg) {
+    int id = *((int *) arg), i;
+    for (i = 0; i < POOL_OBJECTS; i++) {
+        poolObjects[id][i] = myPoolAlloc(sharedPool);
+        if (!poolObjects[id][i] || !verifyPattern(poolObjects[id][i], POOL_OBJECT_SIZE, 0x5A)) {
+            poolOk = 0;
+            return NULL;
+        }
+        memset(poolObjects[id][i], id, POOL_OBJECT_SIZE);
+    }
+    pthread_barrier_wait(&poolBarrier);
+    // free the next thread's objects
+    int other = (id + 1) % POOL_THREADS;
+    for (i = 0; i < POOL_OBJECTS; i++) {
+        if (!verifyPattern(poolObjects[other][i], POOL_OBJECT_SIZE, other)) {
+            poolOk = 0;
+        }
+        myPoolFree(sharedPool, poolObjects[other][i]);
+    }
+    return NULL;
+}
+
+void testPools() {
+    pthread_t threads[POOL_THREADS];
+    int ids[POOL_THREADS], i;
+
+    printf("\nTesting pools...\n");
+    sharedPool = myPoolCreate(POOL_OBJECT_SIZE, 8, constructObject, NULL);
+    check(sharedPool != NULL, "Pool creation");
+    if (!sharedPool) return;
+    pthread_barrier_init(&poolBarrier, NULL, POOL_THREADS);
+    for (i = 0; i < POOL_THREADS; i++) {
+        ids[i] = i;
+        pthread_create(&threads[i], NULL, poolWorker, &ids[i]);
+    }
+    for (i = 0; i < POOL_THREADS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    pthread_barrier_destroy(&poolBarrier);
+    check(poolOk, "Pool objects across threads");
+
+    // a slab holds 81 objects over four pages, so most of these are past its first page
+    void *objects[100];
+    int mapped = 1;
+    for (i = 0; i < 100; i++) {
+        objects[i] = myPoolAlloc(sharedPool);
+        span *slab = spanOf(objects[i]);
+        mapped &= (slab != NULL && slab->kind == SPAN_POOL);
+    }
+    check(mapped, "Pool slab pages in the page map");
+    memset(objects[99], 0x77, POOL_OBJECT_SIZE);
+    myFree(objects[99]);
+    check(verifyPattern(objects[99], POOL_OBJECT_SIZE, 0x77), "myFree of a pool object");
+    for (i = 0; i < 100; i++) {
+        myPoolFree(sharedPool, objects[i]);
+    }
+    myPoolDestroy(sharedPool);
+}
+
+// --- Arena Test ---
+// a reset keeps the newest block for the next allocations, and every page of an arena's
+// blocks and big requests leads back to its span, so myFree turns away any arena pointer
+int arenaMapped(void *ptr) {
+    span *s = spanOf(ptr);
+    return s != NULL && s->kind == SPAN_ARENA;
+}
+
+void testArena() {
+    myArena *arena = myArenaCreate();
+    char *p, *newest;
+    int i, ok = 1, mapped = 1;
+
+    printf("\nTesting arenas...\n");
+    check(arena != NULL, "Arena creation");
+    if (!arena) return;
+    // 200 KB of 100-byte requests takes four blocks
+    for (i = 0; i < 2000; i++) {
+        p = myArenaAlloc(arena, 100);
+        if (!p || ((size_t) p % MYMALLOC_ARENA_ALIGN) != 0) ok = 0;
+        mapped &= arenaMapped(p);
+    }
+    check(ok, "Arena allocations");
+    char *big = myArenaAlloc(arena, 100 * 1024);
+    check(big != NULL, "Big arena request");
+    memset(big, 0x3C, 100 * 1024);
+    mapped &= arenaMapped(big + 50 * 1024);
+    check(mapped, "Arena pages in the page map");
+    myFree(big + 50 * 1024);
+    myFree(p);
+    check(verifyPattern((unsigned char *) big, 100 * 1024, 0x3C), "myFree of arena memory");
+
+    newest = arena->blocks->start;
+    myArenaReset(arena);
+    check(arena->blocks->next == NULL && arena->large == NULL, "Arena reset");
+    p = myArenaAlloc(arena, 100);
+    check(p == newest, "Arena block reuse after reset");
+    myArenaDestroy(arena);
+}
+
+// --- Buddy Test ---
+// 2 KB blocks split a region and merge back into it once all are free, so 16 KB blocks fit
+// without a new region; a second free of a block is reported and not counted
+#define BUDDY_BLOCKS 32
+
+void testBuddy() {
+    myMallocStatistics stats;
+    void *blocks[BUDDY_BLOCKS];
+    long regions, frees;
+    int i, ok = 1;
+
+    printf("\nTesting the buddy tier...\n");
+    if (myInit(1, 0) != 0) {
+        printf("Memory initialization failed.\n");
+        return;
+    }
+    for (i = 0; i < BUDDY_BLOCKS; i++) {
+        blocks[i] = myMalloc(1500);
+        if (!blocks[i]) ok = 0;
+        else memset(blocks[i], i, 1500);
+    }
+    for (i = 0; i < BUDDY_BLOCKS; i++) {
+        if (blocks[i] && !verifyPattern(blocks[i], 1500, i)) ok = 0;
+    }
+    check(ok, "Buddy blocks");
+    myMallocStats(&stats);
+    // 1500 of the 2048 bytes of each block were asked for
+    check(stats.classes[MYMALLOC_CLASSES].blockSize == 2048 &&
+          stats.classes[MYMALLOC_CLASSES].requestedBytes == BUDDY_BLOCKS * 1500 &&
+          stats.classes[MYMALLOC_CLASSES].internalFragmentation > 0.26 &&
+          stats.classes[MYMALLOC_CLASSES].internalFragmentation < 0.27, "Buddy internal fragmentation");
+    for (i = 0; i < BUDDY_BLOCKS; i++) {
+        myFree(blocks[i]);
+    }
+
+    regions = buddyRegionBytes();
+    for (i = 0; i < 4; i++) {
+        blocks[i] = myMalloc(16 * 1024);
+    }
+    check(buddyRegionBytes() == regions && blocks[0] && blocks[1] && blocks[2] && blocks[3], "Buddy merge");
+    for (i = 0; i < 4; i++) {
+        myFree(blocks[i]);
+    }
+
+    blocks[0] = myMalloc(4096);
+    myFree(blocks[0]);
+    myMallocStats(&stats);
+    frees = stats.frees;
+    myFree(blocks[0]);
+    myMallocStats(&stats);
+    blocks[1] = myMalloc(4096);
+    blocks[2] = myMalloc(4096);
+    check(stats.frees == frees && blocks[1] != blocks[2], "Buddy double free");
+    myFree(blocks[1]);
+    myFree(blocks[2]);
+}
+
 int main() {
     double startTime, endTime;
     struct timeval start, end;
     gettimeofday(&start, NULL);
     startTime = start.tv_sec + start.tv_usec / 1000000.0;
     testMyMalloc();
+    testSizeClasses();
+    testPageHeap();
+    testSlabMap();
+    testLifo();
+    testThreadExit();
+    testRemoteFree();
+    testExitedHeap();
+    testOverflow(0);
+    testOverflow(1);
+    testBatchRefill();
+    testStatsDump();
+    testStatsTotals();
+    testFastPath();
+    testPerCpu();
+    testBatch();
+    testPools();
+    testArena();
+    testBuddy();
     gettimeofday(&end, NULL);
     endTime = end.tv_sec + end.tv_usec / 1000000.0;
     printf("Time: %f\n", endTime - startTime);
-    return 0;
-}
\ No newline at end of file
+    return checksFailed != 0;
+}
@@ -0,0 +1,114 @@
+// CSc 422
+// Program 2 code for myMalloc arenas: bump allocation through page-heap blocks, freed all
+// at once, with freed blocks cached for the next arena that needs one
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+#include "myMalloc-pages.h"
+#include "myMalloc-arena.h"
+
+#define ARENA_BLOCK_PAGES 16                     // 64 KB blocks
+#define ARENA_BLOCK_BYTES (ARENA_BLOCK_PAGES * PAGE_BYTES)
+#define ARENA_LARGE_BYTES (ARENA_BLOCK_BYTES / 4)  // bigger requests get pages of their own
+#define ARENA_CACHE_BLOCKS 256                   // blocks kept for reuse (16 MB); the rest go back to the page heap
+
+// blocks that arenas have let go of, linked through next
+static span *blockCache;
+static int blockCacheCount;
+static pthread_mutex_t blockCacheLock = PTHREAD_MUTEX_INITIALIZER;
+
+myArena *myArenaCreate() {
+  myArena *arena = malloc(sizeof(myArena));
+  if (!arena) return NULL;
+  arena->next = arena->end = NULL;
+  arena->blocks = NULL;
+  arena->large = NULL;
+  return arena;
+}
+
+// a block from the cache, else from the page heap
+static span *takeBlock() {
+  span *block;
+
+  pthread_mutex_lock(&blockCacheLock);
+  block = blockCache;
+  if (block) {
+    blockCache = block->next;
+    blockCacheCount--;
+  }
+  pthread_mutex_unlock(&blockCacheLock);
+  return block ? block : pageAlloc(ARENA_BLOCK_PAGES, SPAN_ARENA);
+}
+
+// hand the chain of blocks from first on to the cache, as far as it has room, and the
+// rest back to the page heap
+static void releaseBlocks(span *first) {
+  span *block, *next;
+
+  pthread_mutex_lock(&blockCacheLock);
+  for (block = first; block && blockCacheCount < ARENA_CACHE_BLOCKS; block = next) {
+    next = block->next;
+    block->next = blockCache;
+    blockCache = block;
+    blockCacheCount++;
+  }
+  pthread_mutex_unlock(&blockCacheLock);
+  for (; block; block = next) {
+    next = block->next;
+    pageFree(block);
+  }
+}
+
+static void releaseLarge(myArena *arena) {
+  span *s, *next;
+  for (s = arena->large; s; s = next) {
+    next = s->next;
+    pageFree(s);
+  }
+  arena->large = NULL;
+}
+
+void *myArenaAllocSlow(myArena *arena, int size) {
+  size_t bytes;
+  span *s;
+
+  if (size < 0) {
+    return NULL;
+  }
+  bytes = myArenaBytes(size);
+  if (bytes > ARENA_LARGE_BYTES) {
+    s = pageAlloc((bytes + PAGE_BYTES - 1) >> PAGE_SHIFT, SPAN_ARENA);
+    if (!s) return NULL;
+    s->next = arena->large;
+    arena->large = s;
+    return s->start;
+  }
+  // the rest of the current block is abandoned until the next reset
+  s = takeBlock();
+  if (!s) return NULL;
+  s->next = arena->blocks;
+  arena->blocks = s;
+  arena->next = s->start + bytes;
+  arena->end = s->start + ARENA_BLOCK_BYTES;
+  return s->start;
+}
+
+void myArenaReset(myArena *arena) {
+  span *current = arena->blocks;
+
+  releaseLarge(arena);
+  if (!current) {
+    return;
+  }
+  releaseBlocks(current->next);
+  current->next = NULL;
+  arena->next = current->start;
+  arena->end = current->start + ARENA_BLOCK_BYTES;
+}
+
+void myArenaDestroy(myArena *arena) {
+  releaseLarge(arena);
+  releaseBlocks(arena->blocks);
+  free(arena);
+}
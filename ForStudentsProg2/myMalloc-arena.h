@@ -0,0 +1,50 @@
+// CSc 422
+// Program 2 header file for myMalloc arenas
+
+#ifndef MYMALLOC_ARENA_H
+#define MYMALLOC_ARENA_H
+
+#include <stddef.h>
+
+// an arena hands out memory by bumping a pointer through 64 KB blocks from the page heap,
+// and frees all of it at once: myArenaReset keeps the newest block for reuse and gives
+// the others to a cache of blocks shared by every arena, and myArenaDestroy gives all of
+// them. Requests above a quarter of a block get pages of their own, which go back to the
+// page heap on reset. Allocations are 16-byte aligned and cannot be freed one at a time;
+// an arena belongs to one thread at a time, and works with or without myInit
+#define MYMALLOC_ARENA_ALIGN 16
+
+typedef struct myArena {
+  char *next;            // bump pointer into the current block
+  char *end;
+  struct span *blocks;   // current block first, linked through next
+  struct span *large;    // pages of requests above a quarter of a block
+} myArena;
+
+// an empty arena, or NULL if out of memory; it takes no block until the first allocation
+myArena *myArenaCreate();
+void myArenaReset(myArena *arena);
+void myArenaDestroy(myArena *arena);
+
+// bytes of an arena a request of size takes: size rounded up to the alignment, and one
+// unit for 0, so that every allocation has an address of its own
+static inline size_t myArenaBytes(int size) {
+  if (size == 0) return MYMALLOC_ARENA_ALIGN;
+  return ((size_t) size + MYMALLOC_ARENA_ALIGN - 1) & ~(size_t) (MYMALLOC_ARENA_ALIGN - 1);
+}
+
+// slow path of myArenaAlloc: a new block, or pages of its own; NULL if out of memory
+void *myArenaAllocSlow(myArena *arena, int size);
+
+// size bytes from arena, or NULL if size is negative or memory runs out
+static inline void *myArenaAlloc(myArena *arena, int size) {
+  size_t bytes = myArenaBytes(size);
+  if (size >= 0 && bytes <= (size_t) (arena->end - arena->next)) {
+    void *block = arena->next;
+    arena->next += bytes;
+    return block;
+  }
+  return myArenaAllocSlow(arena, size);
+}
+
+#endif
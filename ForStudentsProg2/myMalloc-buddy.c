@@ -0,0 +1,147 @@
+// CSc 422
+// Program 2 code for the myMalloc buddy tier: power-of-two blocks from 2 KB to 16 KB,
+// split from and merged back into 64 KB regions
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "myMalloc-buddy.h"
+
+#define UNIT_BYTES ((size_t) 1 << BUDDY_MIN_SHIFT)
+#define REGION_ORDER (BUDDY_ORDERS + 1)   // a whole region is one free block of this order
+#define REGION_BYTES (UNIT_BYTES << REGION_ORDER)
+#define REGION_UNITS (REGION_BYTES / UNIT_BYTES)
+
+// a region's map has a byte per 2 KB unit: the order of the block that starts there,
+// marked free if it is, or INTERIOR for units inside a block
+#define UNIT_FREE 0x80
+#define UNIT_INTERIOR 0x40
+
+// free blocks of each order, doubly linked through their first two words so that a
+// block can leave its list when its buddy merges with it
+typedef struct freeBlock {
+  struct freeBlock *next;
+  struct freeBlock *prev;
+} freeBlock;
+
+static freeBlock *freeLists[REGION_ORDER + 1];
+static long regionBytes;
+static pthread_mutex_t buddyLock = PTHREAD_MUTEX_INITIALIZER;
+
+int buddyOrder(int size) {
+  int order = 0;
+  while ((UNIT_BYTES << order) < (size_t) size) {
+    order++;
+  }
+  return order;
+}
+
+// free list routines (buddyLock held)
+static void listInsert(int order, freeBlock *block) {
+  block->prev = NULL;
+  block->next = freeLists[order];
+  if (block->next) block->next->prev = block;
+  freeLists[order] = block;
+}
+
+static void listRemove(int order, freeBlock *block) {
+  if (block->prev) {
+    block->prev->next = block->next;
+  } else {
+    freeLists[order] = block->next;
+  }
+  if (block->next) block->next->prev = block->prev;
+}
+
+// end of free list routines
+
+// the free block of the given order at offset in region s goes on its list
+static void addFree(span *s, size_t offset, int order) {
+  s->buddy[offset / UNIT_BYTES] = order | UNIT_FREE;
+  listInsert(order, (freeBlock *) (s->start + offset));
+}
+
+// a new region, all of it one free block; 0 if out of memory
+static int newRegion() {
+  span *s = pageAlloc(REGION_BYTES / PAGE_BYTES, SPAN_BUDDY);
+  size_t i;
+
+  if (!s) return 0;
+  s->buddy = malloc(REGION_UNITS);
+  if (!s->buddy) {
+    pageFree(s);
+    return 0;
+  }
+  for (i = 0; i < REGION_UNITS; i++) {
+    s->buddy[i] = UNIT_INTERIOR;
+  }
+  addFree(s, 0, REGION_ORDER);
+  regionBytes += REGION_BYTES;
+  return 1;
+}
+
+void *buddyAlloc(int order) {
+  freeBlock *block;
+  span *s;
+  size_t offset;
+  int j;
+
+  pthread_mutex_lock(&buddyLock);
+  for (j = order; j <= REGION_ORDER && !freeLists[j]; j++);
+  if (j > REGION_ORDER) {
+    if (!newRegion()) {
+      pthread_mutex_unlock(&buddyLock);
+      return NULL;
+    }
+    j = REGION_ORDER;
+  }
+  block = freeLists[j];
+  listRemove(j, block);
+  s = spanOf(block);
+  offset = (char *) block - s->start;
+  // split: the upper half of each step down is a free buddy
+  while (j > order) {
+    j--;
+    addFree(s, offset + (UNIT_BYTES << j), j);
+  }
+  s->buddy[offset / UNIT_BYTES] = order;
+  pthread_mutex_unlock(&buddyLock);
+  return block;
+}
+
+int buddyFree(span *s, void *ptr) {
+  size_t offset = (char *) ptr - s->start, buddyOffset;
+  int order, freed;
+
+  if (offset % UNIT_BYTES != 0) {
+    return -1;
+  }
+  pthread_mutex_lock(&buddyLock);
+  order = s->buddy[offset / UNIT_BYTES];
+  if (order & (UNIT_FREE | UNIT_INTERIOR)) {
+    pthread_mutex_unlock(&buddyLock);
+    return -1;
+  }
+  freed = order;
+  // merge with the buddy while it is a free block of the same order
+  while (order < REGION_ORDER) {
+    buddyOffset = offset ^ (UNIT_BYTES << order);
+    if (s->buddy[buddyOffset / UNIT_BYTES] != (order | UNIT_FREE)) break;
+    listRemove(order, (freeBlock *) (s->start + buddyOffset));
+    s->buddy[(offset > buddyOffset ? offset : buddyOffset) / UNIT_BYTES] = UNIT_INTERIOR;
+    if (buddyOffset < offset) offset = buddyOffset;
+    order++;
+  }
+  addFree(s, offset, order);
+  pthread_mutex_unlock(&buddyLock);
+  return freed;
+}
+
+long buddyRegionBytes() {
+  long bytes;
+  pthread_mutex_lock(&buddyLock);
+  bytes = regionBytes;
+  pthread_mutex_unlock(&buddyLock);
+  return bytes;
+}
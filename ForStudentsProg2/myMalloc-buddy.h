@@ -0,0 +1,31 @@
+// CSc 422
+// Program 2 header file for the myMalloc buddy tier
+
+#ifndef MYMALLOC_BUDDY_H
+#define MYMALLOC_BUDDY_H
+
+#include "myMalloc-pages.h"
+
+// the buddy tier serves requests between the size classes and the page heap, 1025 bytes
+// to 16 KB, from 64 KB regions of the page heap. Blocks are powers of two from 2 KB up;
+// a request takes the smallest that fits, split off a bigger free block, and a freed
+// block merges with its buddy (the other half of the block it was split from) while that
+// is free too. One lock covers the tier; regions stay with it once carved
+#define BUDDY_MIN_SHIFT 11
+#define BUDDY_ORDERS 4          // orders of block handed out: 2, 4, 8 and 16 KB
+#define BUDDY_MAX_BYTES ((int) 1 << (BUDDY_MIN_SHIFT + BUDDY_ORDERS - 1))
+
+// the order of block for a request of size bytes, at most BUDDY_MAX_BYTES
+int buddyOrder(int size);
+
+// a block of the given order, or NULL if the page heap is out of memory
+void *buddyAlloc(int order);
+
+// free ptr, in buddy region s; the order of the block, or -1 if ptr is not an allocated
+// block of the region
+int buddyFree(span *s, void *ptr);
+
+// bytes of regions carved so far
+long buddyRegionBytes();
+
+#endif
@@ -5,90 +5,120 @@
 #include <stdio.h>
 #include "myMalloc-helper.h"
 
-// list routines: implements a circular, doubly-linked list with a dummy header node
+// list routines: implements an intrusive, singly-linked LIFO stack with a dummy header
+// node; malloc and free are a pop and a push that touch only the block itself
 
-// create the list; just allocate a dummy header node, and both next and prev
-// point to the header node
+// create the list; just allocate a dummy header node whose next is the top of the stack
 chunk *createList() {
-  chunk *dummy = (chunk *) malloc(sizeof(chunk));
-  dummy->allocSize = -1;  // this is the header node, not a real list node
-  dummy->next = dummy;
-  dummy->prev = dummy;
+  chunk *dummy = (chunk *) malloc(sizeof(chunk));  // the header node, not a real block
+  dummy->next = NULL;
   return dummy;
 }
 
-// insert curItem into the list after item
-static void insertAfter(chunk *item, chunk *curItem) {
-  curItem->next = item->next;
-  curItem->prev = item;
-  curItem->prev->next = curItem;
-  curItem->next->prev = curItem;
+// push item on the stack
+static void listPush(chunk *list, chunk *item) {
+  item->next = list->next;
+  list->next = item;
 }
 
-// insert curItem into the list before item
-static void insertBefore(chunk *item, chunk *curItem) {
-  insertAfter(item->prev, curItem);
+// pop the top of the stack
+static chunk *listPop(chunk *list) {
+  chunk *item = list->next;
+  list->next = item->next;
+  return item;
 }
 
-// insert chunk at end of list
-static void listAppend(chunk *list, chunk *item) {
-  insertAfter(list->prev, item);
-}
+// end of list routines
 
-// insert chunk at beginning of list
-static void listPush(chunk *list, chunk *item) {
-  insertBefore(list->next, item);
+// take a block of memory and logically divide it into num blocks of blockSize bytes,
+// each of which starts out as a free chunk; they are pushed last first so that they
+// come back off the stack in address order
+void setUpChunks(chunk *list, void *mem, int num, int blockSize) {
+  int i;
+
+  for (i = num - 1; i >= 0; i--) {
+    // note below mem is cast to a (char *), so we are adding i * blockSize bytes
+    chunk *currentChunk = (chunk *) ((char *) mem + i * blockSize);  // start position of the i'th chunk
+    listPush(list, currentChunk);
+  }
 }
 
-// remove item from the list
-static void unlinkItem(chunk *item) {
-  item->prev->next = item->next;
-  item->next->prev = item->prev;
+// get a chunk---pop the most recently freed block and return it; nothing tracks it while
+// it is allocated
+chunk *getChunk(chunk *freeList) {
+  return listPop(freeList);
 }
 
-// return the first list element
-static chunk *listFront(chunk *list) {
-  return list->next;
+// return an allocated block to the top of the free list
+void returnChunk(chunk *freeList, chunk *toFree) {
+  listPush(freeList, toFree);
 }
 
-// empty list check
-static int isEmptyList(chunk *list) {
-  return (list->next == list);
+// move every block on from to the top of to, leaving from empty; returns how many moved
+int moveChunks(chunk *to, chunk *from) {
+  chunk *last = from->next;
+  int count = 1;
+
+  if (!last) {
+    return 0;
+  }
+  while (last->next) {
+    last = last->next;
+    count++;
+  }
+  last->next = to->next;
+  to->next = from->next;
+  from->next = NULL;
+  return count;
 }
 
-// end of list routines
+// pop up to n blocks into out, most recently freed first; returns how many there were
+int takeChunks(chunk *freeList, void **out, int n) {
+  chunk *item = freeList->next;
+  int count;
 
-// take a block of memory and logically divide it into chunks
-// note that blocksize is here because it's necessary when you add
-// large blocks
-void setUpChunks(chunk *list, void *mem, int num, int blockSize) {
+  for (count = 0; count < n && item; count++) {
+    out[count] = item;
+    item = item->next;
+  }
+  freeList->next = item;
+  return count;
+}
+
+// return the n blocks of items, linked in array order, to the top of the free list in
+// one splice; items[0] ends up on top
+void returnChunks(chunk *freeList, void **items, int n) {
   int i;
-  int chunkSize = sizeof(chunk) + blockSize;
 
-  for (i = 0; i < num; i++) {
-    // note below mem is cast to a (char *), so we are adding i * chunksize bytes 
-    chunk *currentChunk = (chunk *) ((char *) mem + i * chunkSize);  // start position of the i'th chunk
-    currentChunk->allocSize = blockSize;	
-    listAppend(list, currentChunk);  // put this chunk at the end of the list
+  if (n <= 0) {
+    return;
   }
+  ((chunk *) items[n - 1])->next = freeList->next;
+  for (i = n - 2; i >= 0; i--) {
+    ((chunk *) items[i])->next = (chunk *) items[i + 1];
+  }
+  freeList->next = (chunk *) items[0];
 }
 
-// used to move a block to a specified list
-static void moveToTargetList(chunk *toMove, chunk *toList) {
-  // remove toMove from its list
-  unlinkItem(toMove);
-  // now push it on to the destination list
-  listPush(toList, toMove);
+// push item on a remote-free queue; the compare-and-swap retries if another thread pushed
+// first. Taking the whole queue at once means no block is popped while others still see
+// it, so the usual ABA problem of lock-free stacks cannot arise
+void remotePush(chunk **queue, chunk *item) {
+  remotePushList(queue, item, item);
 }
 
-// get a chunk---grab first available chunk, put on allocated list, and return pointer to the chunk
-chunk *getChunk(chunk *freeList, chunk *allocList) {
-  chunk *toAlloc = listFront(freeList);
-  moveToTargetList(toAlloc, allocList);
-  return toAlloc;
+// push the blocks from first to last, already linked, on a remote-free queue in one step
+void remotePushList(chunk **queue, chunk *first, chunk *last) {
+  chunk *top = __atomic_load_n(queue, __ATOMIC_RELAXED);
+  do {
+    last->next = top;
+  } while (!__atomic_compare_exchange_n(queue, &top, first, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
 }
 
-// return a chunk from the allocated list to the free list
-void returnChunk(chunk *freeList, chunk *allocList, chunk *toFree) {
-  moveToTargetList(toFree, freeList);
+// empty a remote-free queue, returning its blocks as a NULL-terminated chain
+chunk *remoteTakeAll(chunk **queue) {
+  if (!__atomic_load_n(queue, __ATOMIC_RELAXED)) {
+    return NULL;
+  }
+  return __atomic_exchange_n(queue, NULL, __ATOMIC_ACQUIRE);
 }
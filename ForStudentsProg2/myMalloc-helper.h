@@ -1,15 +1,28 @@
 // CSc 422
 // Program 2 header file for sequential myMalloc-helper
 
-// a chunk is a integer (allocSize) along with prev and next pointers
-// implicitly, after each of these, there is data of allocSize
+#ifndef MYMALLOC_HELPER_H
+#define MYMALLOC_HELPER_H
+
+// a chunk is the next pointer that a free block holds in its first bytes; once the
+// block is handed out all of it is user data, so blocks have no header and must be at
+// least sizeof(chunk) bytes
 typedef struct chunk {
-  int allocSize;
-  struct chunk *prev;
   struct chunk *next;
 } chunk;
 
 chunk *createList();
 void setUpChunks(chunk *list, void *mem, int num, int blockSize);
-chunk *getChunk(chunk *freeList, chunk *allocList);
-void returnChunk(chunk *freeList, chunk *allocList, chunk *toFree);
+chunk *getChunk(chunk *freeList);
+void returnChunk(chunk *freeList, chunk *toFree);
+int moveChunks(chunk *to, chunk *from);
+int takeChunks(chunk *freeList, void **out, int n);
+void returnChunks(chunk *freeList, void **items, int n);
+
+// remote-free queues: a NULL-terminated stack with no header that any thread may push
+// onto without a lock, and that one thread empties all at once
+void remotePush(chunk **queue, chunk *item);
+void remotePushList(chunk **queue, chunk *first, chunk *last);
+chunk *remoteTakeAll(chunk **queue);
+
+#endif
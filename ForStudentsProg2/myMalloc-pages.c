@@ -0,0 +1,267 @@
+// CSc 422
+// Program 2 code for the myMalloc page heap: page-granular spans for size-class slabs and
+// for blocks above 1024 bytes
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include "myMalloc-pages.h"
+
+#define SEGMENT_PAGES 1024             // the page heap grows by 4 MB segments
+#define MAX_BIN_PAGES 128              // free spans up to this size are binned by exact size
+#define HUGE_PAGES 256                 // blocks above 1 MB get a mapping of their own
+#define HUGE_CACHE_BYTES ((size_t) 64 << 20)  // freed huge mappings kept for reuse
+
+mapNode pageMap;
+static pthread_mutex_t pageLock = PTHREAD_MUTEX_INITIALIZER;
+static span *freeBins[MAX_BIN_PAGES + 1];  // [n] holds free spans of n pages, [0] the bigger ones
+static span *hugeCache;
+static size_t hugeCacheBytes;
+
+// the page map slot for addr, creating the path to it (pageLock held); spanOf in the
+// header reads the map
+static void **mapSlot(void *addr) {
+  uintptr_t page = (uintptr_t) addr >> PAGE_SHIFT;
+  void **slot = &pageMap.entries[(page >> (2 * MAP_BITS)) & MAP_MASK];
+  int level;
+
+  for (level = 1; level >= 0; level--) {
+    mapNode *node = __atomic_load_n((mapNode **) slot, __ATOMIC_ACQUIRE);
+    if (!node) {
+      node = calloc(1, sizeof(mapNode));
+      if (!node) return NULL;
+      __atomic_store_n((mapNode **) slot, node, __ATOMIC_RELEASE);
+    }
+    slot = &node->entries[(page >> (level * MAP_BITS)) & MAP_MASK];
+  }
+  return slot;
+}
+
+static int mapSet(void *addr, span *s) {
+  void **slot = mapSlot(addr);
+  if (!slot) return 0;
+  __atomic_store_n((span **) slot, s, __ATOMIC_RELEASE);
+  return 1;
+}
+
+// record s on its first and last page, which is all that coalescing and spanOf need
+static int mapEnds(span *s) {
+  return mapSet(s->start, s) && mapSet(s->start + (s->pages - 1) * PAGE_BYTES, s);
+}
+
+// record s on every page, so that a pointer into any block of a slab finds it
+static int mapAll(span *s) {
+  size_t i;
+  for (i = 0; i < s->pages; i++) {
+    if (!mapSet(s->start + i * PAGE_BYTES, s)) return 0;
+  }
+  return 1;
+}
+
+// the kinds that pageAlloc records on every page rather than just the ends
+static int mappedAll(int kind) {
+  return kind == SPAN_SLAB || kind == SPAN_POOL || kind == SPAN_ARENA || kind == SPAN_BUDDY;
+}
+
+// forget s in the page map before its struct is freed or merged into another span, so
+// that no page leads to it; the paths exist already, so this cannot fail
+static void mapClear(span *s) {
+  size_t i;
+  if (mappedAll(s->kind)) {
+    for (i = 1; i + 1 < s->pages; i++) {
+      mapSet(s->start + i * PAGE_BYTES, NULL);
+    }
+  }
+  mapSet(s->start, NULL);
+  mapSet(s->start + (s->pages - 1) * PAGE_BYTES, NULL);
+}
+
+static span *newSpan(char *start, size_t pages, int kind) {
+  span *s = malloc(sizeof(span));
+  if (!s) return NULL;
+  s->start = start;
+  s->pages = pages;
+  s->kind = kind;
+  s->sizeClass = -1;
+  s->owner = NULL;
+  s->live = NULL;
+  s->buddy = NULL;
+  s->prev = s->next = NULL;
+  return s;
+}
+
+// free bin list routines: doubly linked, NULL terminated
+static span **binFor(size_t pages) {
+  return &freeBins[(pages <= MAX_BIN_PAGES) ? pages : 0];
+}
+
+static void binInsert(span *s) {
+  span **bin = binFor(s->pages);
+  s->prev = NULL;
+  s->next = *bin;
+  if (*bin) (*bin)->prev = s;
+  *bin = s;
+}
+
+static void binRemove(span *s) {
+  if (s->prev) {
+    s->prev->next = s->next;
+  } else {
+    *binFor(s->pages) = s->next;
+  }
+  if (s->next) s->next->prev = s->prev;
+}
+
+// smallest free span of at least pages: exact bins first, then first fit among the big ones
+static span *takeFree(size_t pages) {
+  size_t n;
+  span *s;
+  for (n = pages; n <= MAX_BIN_PAGES; n++) {
+    if (freeBins[n]) {
+      s = freeBins[n];
+      binRemove(s);
+      return s;
+    }
+  }
+  for (s = freeBins[0]; s; s = s->next) {
+    if (s->pages >= pages) {
+      binRemove(s);
+      return s;
+    }
+  }
+  return NULL;
+}
+
+span *pageAlloc(size_t pages, int kind) {
+  span *s, *rest;
+
+  pthread_mutex_lock(&pageLock);
+  s = takeFree(pages);
+  if (!s) {
+    size_t n = (pages > SEGMENT_PAGES) ? pages : SEGMENT_PAGES;
+    char *mem = mmap(NULL, n * PAGE_BYTES, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED || !(s = newSpan(mem, n, SPAN_FREE))) {
+      pthread_mutex_unlock(&pageLock);
+      return NULL;
+    }
+  }
+  // give back what is not needed
+  if (s->pages > pages) {
+    rest = newSpan(s->start + pages * PAGE_BYTES, s->pages - pages, SPAN_FREE);
+    if (rest) {
+      s->pages = pages;
+      mapEnds(rest);
+      binInsert(rest);
+    }
+  }
+  s->kind = kind;
+  if (!(mappedAll(kind) ? mapAll(s) : mapEnds(s))) {
+    s->kind = SPAN_FREE;
+    binInsert(s);
+    s = NULL;
+  }
+  pthread_mutex_unlock(&pageLock);
+  return s;
+}
+
+void pageFree(span *s) {
+  span *neighbour;
+
+  pthread_mutex_lock(&pageLock);
+  mapClear(s);
+  s->kind = SPAN_FREE;
+  // coalesce with the free spans that end just before and start just after s; whichever
+  // struct is absorbed leaves the map before it is freed, and the merged span's ends are
+  // recorded again below
+  neighbour = spanOf(s->start - PAGE_BYTES);
+  if (neighbour && neighbour->kind == SPAN_FREE && neighbour->start + neighbour->pages * PAGE_BYTES == s->start) {
+    binRemove(neighbour);
+    mapClear(neighbour);
+    neighbour->pages += s->pages;
+    free(s);
+    s = neighbour;
+  }
+  neighbour = spanOf(s->start + s->pages * PAGE_BYTES);
+  if (neighbour && neighbour->kind == SPAN_FREE && neighbour->start == s->start + s->pages * PAGE_BYTES) {
+    binRemove(neighbour);
+    mapClear(neighbour);
+    s->pages += neighbour->pages;
+    free(neighbour);
+  }
+  mapEnds(s);
+  binInsert(s);
+  pthread_mutex_unlock(&pageLock);
+}
+
+// a huge block: reuse a cached mapping no more than twice the size needed, else mmap one
+static void *hugeAlloc(size_t pages) {
+  span *s;
+  char *mem;
+
+  pthread_mutex_lock(&pageLock);
+  for (s = hugeCache; s; s = s->next) {
+    if (s->pages >= pages && s->pages <= 2 * pages) {
+      if (s->prev) {
+        s->prev->next = s->next;
+      } else {
+        hugeCache = s->next;
+      }
+      if (s->next) s->next->prev = s->prev;
+      hugeCacheBytes -= s->pages * PAGE_BYTES;
+      // the path to its page is still there from the first time, so this cannot fail
+      mapSet(s->start, s);
+      pthread_mutex_unlock(&pageLock);
+      return s->start;
+    }
+  }
+  mem = mmap(NULL, pages * PAGE_BYTES, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mem == MAP_FAILED) {
+    pthread_mutex_unlock(&pageLock);
+    return NULL;
+  }
+  s = newSpan(mem, pages, SPAN_HUGE);
+  if (!s || !mapSet(mem, s)) {
+    munmap(mem, pages * PAGE_BYTES);
+    free(s);
+    mem = NULL;
+  }
+  pthread_mutex_unlock(&pageLock);
+  return mem;
+}
+
+void *largeAlloc(size_t size) {
+  size_t pages = (size + PAGE_BYTES - 1) >> PAGE_SHIFT;
+  span *s;
+
+  if (pages > HUGE_PAGES) {
+    return hugeAlloc(pages);
+  }
+  s = pageAlloc(pages, SPAN_LARGE);
+  return s ? s->start : NULL;
+}
+
+void largeFree(span *s) {
+  if (s->kind != SPAN_HUGE) {
+    pageFree(s);
+    return;
+  }
+  pthread_mutex_lock(&pageLock);
+  // whether the mapping is cached or going away, its page must no longer lead to s, so a
+  // second free of the block is reported instead of putting s in the cache twice
+  mapSet(s->start, NULL);
+  if (hugeCacheBytes + s->pages * PAGE_BYTES <= HUGE_CACHE_BYTES) {
+    s->prev = NULL;
+    s->next = hugeCache;
+    if (hugeCache) hugeCache->prev = s;
+    hugeCache = s;
+    hugeCacheBytes += s->pages * PAGE_BYTES;
+    pthread_mutex_unlock(&pageLock);
+    return;
+  }
+  pthread_mutex_unlock(&pageLock);
+  munmap(s->start, s->pages * PAGE_BYTES);
+  free(s);
+}
@@ -0,0 +1,69 @@
+// CSc 422
+// Program 2 header file for the myMalloc page heap
+
+#ifndef MYMALLOC_PAGES_H
+#define MYMALLOC_PAGES_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// the page heap hands out spans: runs of whole pages carved from large mmap'd segments,
+// or a mapping of their own for huge blocks. Every span is recorded in a page map, so any
+// pointer to the start of a span, or anywhere in a slab, pool slab, arena span or buddy
+// region, leads back to it
+#define PAGE_SHIFT 12
+#define PAGE_BYTES ((size_t) 1 << PAGE_SHIFT)
+
+#define SPAN_FREE 0   // in the page heap's free bins
+#define SPAN_LARGE 1  // a large block from a segment
+#define SPAN_HUGE 2   // a large block with its own mapping
+#define SPAN_SLAB 3   // blocks of one size class; every page is in the page map
+#define SPAN_POOL 4   // objects of a myPool, which gives the span back itself; every page is in the page map
+#define SPAN_ARENA 5  // a myArena block, or the pages of one big arena request; every page is in the page map
+#define SPAN_BUDDY 6  // a buddy tier region; every page is in the page map
+
+typedef struct span {
+  char *start;
+  size_t pages;
+  int kind;
+  int sizeClass;      // SPAN_SLAB only
+  void *owner;        // SPAN_SLAB only: the memory manager the slab belongs to
+  unsigned char *live;  // SPAN_SLAB in debug builds: one bit per allocated block
+  unsigned char *buddy; // SPAN_BUDDY: the state of each 2 KB unit (see myMalloc-buddy.c)
+  struct span *prev;  // free bin or huge cache links
+  struct span *next;
+} span;
+
+// pages contiguous pages of the given kind; NULL if the system is out of memory
+span *pageAlloc(size_t pages, int kind);
+void pageFree(span *s);
+
+// large blocks: pageAlloc spans up to HUGE_PAGES pages, a cached or fresh mapping beyond
+void *largeAlloc(size_t size);
+void largeFree(span *s);
+
+// page map: a three-level radix tree over 48-bit addresses, 12 bits of page number per
+// level. Entries are written under the page heap's lock and read without it, so nodes
+// are published with release stores and never freed
+#define MAP_BITS 12
+#define MAP_FANOUT (1 << MAP_BITS)
+#define MAP_MASK (MAP_FANOUT - 1)
+
+typedef struct mapNode {
+  void *entries[MAP_FANOUT];
+} mapNode;
+
+extern mapNode pageMap;
+
+// the span that starts on ptr's page (or that holds it, for slabs), or NULL if the page
+// heap does not own it; inline, since myFree asks for every block
+static inline span *spanOf(void *ptr) {
+  uintptr_t page = (uintptr_t) ptr >> PAGE_SHIFT;
+  mapNode *node = __atomic_load_n((mapNode **) &pageMap.entries[(page >> (2 * MAP_BITS)) & MAP_MASK], __ATOMIC_ACQUIRE);
+  if (!node) return NULL;
+  node = __atomic_load_n((mapNode **) &node->entries[(page >> MAP_BITS) & MAP_MASK], __ATOMIC_ACQUIRE);
+  if (!node) return NULL;
+  return __atomic_load_n((span **) &node->entries[page & MAP_MASK], __ATOMIC_ACQUIRE);
+}
+
+#endif
@@ -0,0 +1,211 @@
+// CSc 422
+// Program 2 code for the myMalloc per-CPU caches (flag 3): arrays of free blocks per CPU
+// and class, updated with restartable sequences where the kernel and C library have them
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <sched.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "myMalloc-percpu.h"
+
+#if defined(__x86_64__) && defined(__has_include)
+#if __has_include(<sys/rseq.h>)
+#include <sys/rseq.h>
+#ifdef RSEQ_SIG
+#define HAVE_RSEQ 1
+#endif
+#endif
+#endif
+
+typedef struct cpuClass {
+  long count;
+  void *slots[CPU_SLOTS];
+} cpuClass;
+
+// one CPU's classes, on cache lines of their own; lock is only used without rseq
+typedef struct cpuCache {
+  pthread_mutex_t lock;
+  cpuClass *classes;
+} __attribute__((aligned(64))) cpuCache;
+
+static cpuCache *cpuCaches;
+static int numCpus;
+static int useRseq;
+
+#ifdef HAVE_RSEQ
+// the calling thread's rseq area, which glibc registered with the kernel
+static inline struct rseq *rseqArea() {
+  return (struct rseq *) ((char *) __builtin_thread_pointer() + __rseq_offset);
+}
+
+// the start of a critical section from label 1 up to the commit that ends at label 2;
+// the kernel restarts the thread at label 4, which is preceded by glibc's signature
+#define RSEQ_SECTION_BEGIN \
+  ".pushsection __rseq_cs, \"aw\"\n\t" \
+  ".balign 32\n\t" \
+  "3:\n\t" \
+  ".long 0x0, 0x0\n\t" \
+  ".quad 1f, (2f - 1f), 4f\n\t" \
+  ".popsection\n\t" \
+  "leaq 3b(%%rip), %%rax\n\t" \
+  "movq %%rax, %[rseqCs]\n\t" \
+  "1:\n\t" \
+  "cmpl %[cpu], %[cpuId]\n\t" \
+  "jnz 4f\n\t"
+
+#define RSEQ_SECTION_END \
+  "2:\n\t" \
+  ".pushsection __rseq_failure, \"ax\"\n\t" \
+  ".byte 0x0f, 0xb9, 0x3d\n\t" \
+  ".long " RSEQ_SIG_STRING "\n\t" \
+  "4:\n\t" \
+  "jmp %l[abort]\n\t" \
+  ".popsection\n\t"
+
+#define RSEQ_STRING(x) #x
+#define RSEQ_EXPAND(x) RSEQ_STRING(x)
+#define RSEQ_SIG_STRING RSEQ_EXPAND(RSEQ_SIG)
+
+static void *rseqPop(int c) {
+  for (;;) {
+    struct rseq *rs = rseqArea();
+    unsigned int cpu = __atomic_load_n(&rs->cpu_id_start, __ATOMIC_RELAXED);
+    void *item = NULL;
+    cpuClass *cls;
+
+    if (cpu >= (unsigned int) numCpus) return NULL;
+    cls = &cpuCaches[cpu].classes[c];
+    // count--, then the block in the slot it leaves
+    __asm__ __volatile__ goto (
+      RSEQ_SECTION_BEGIN
+      "movq %[count], %%rax\n\t"
+      "testq %%rax, %%rax\n\t"
+      "jz %l[empty]\n\t"
+      "subq $1, %%rax\n\t"
+      "movq (%[slots], %%rax, 8), %%rcx\n\t"
+      "movq %%rcx, (%[item])\n\t"
+      "movq %%rax, %[count]\n\t"
+      RSEQ_SECTION_END
+      :
+      : [rseqCs] "m" (rs->rseq_cs), [cpuId] "m" (rs->cpu_id), [cpu] "r" (cpu),
+        [count] "m" (cls->count), [slots] "r" (cls->slots), [item] "r" (&item)
+      : "memory", "cc", "rax", "rcx"
+      : empty, abort);
+    return item;
+  empty:
+    return NULL;
+  abort:
+    continue;
+  }
+}
+
+static int rseqPush(int c, void *block) {
+  for (;;) {
+    struct rseq *rs = rseqArea();
+    unsigned int cpu = __atomic_load_n(&rs->cpu_id_start, __ATOMIC_RELAXED);
+    cpuClass *cls;
+
+    if (cpu >= (unsigned int) numCpus) return 0;
+    cls = &cpuCaches[cpu].classes[c];
+    // the block in the slot past the last, then count++
+    __asm__ __volatile__ goto (
+      RSEQ_SECTION_BEGIN
+      "movq %[count], %%rax\n\t"
+      "cmpq %[slotCount], %%rax\n\t"
+      "jae %l[full]\n\t"
+      "movq %[block], (%[slots], %%rax, 8)\n\t"
+      "addq $1, %%rax\n\t"
+      "movq %%rax, %[count]\n\t"
+      RSEQ_SECTION_END
+      :
+      : [rseqCs] "m" (rs->rseq_cs), [cpuId] "m" (rs->cpu_id), [cpu] "r" (cpu),
+        [count] "m" (cls->count), [slots] "r" (cls->slots), [block] "r" (block),
+        [slotCount] "n" (CPU_SLOTS)
+      : "memory", "cc", "rax"
+      : full, abort);
+    return 1;
+  full:
+    return 0;
+  abort:
+    continue;
+  }
+}
+
+// rseq works for this thread: glibc registered the area and the kernel has filled it in
+static int rseqRegistered() {
+  return __rseq_size > 0 && (int) rseqArea()->cpu_id >= 0;
+}
+#endif
+
+// the current CPU's cache, locked, for the fallback; CPU numbers that sched_getcpu cannot
+// give or that are out of range share the first cache
+static cpuCache *lockCpu() {
+  int cpu = sched_getcpu();
+  cpuCache *cache = &cpuCaches[(cpu >= 0 && cpu < numCpus) ? cpu : 0];
+  pthread_mutex_lock(&cache->lock);
+  return cache;
+}
+
+int percpuInit(int numClasses) {
+  int i;
+
+  if (cpuCaches) {
+    for (i = 0; i < numCpus; i++) {
+      free(cpuCaches[i].classes);
+    }
+    free(cpuCaches);
+    cpuCaches = NULL;
+  }
+  numCpus = (int) sysconf(_SC_NPROCESSORS_CONF);
+  if (numCpus < 1) numCpus = 1;
+  cpuCaches = calloc(numCpus, sizeof(cpuCache));
+  if (!cpuCaches) return -1;
+  for (i = 0; i < numCpus; i++) {
+    pthread_mutex_init(&cpuCaches[i].lock, NULL);
+    cpuCaches[i].classes = calloc(numClasses, sizeof(cpuClass));
+    if (!cpuCaches[i].classes) return -1;
+  }
+#ifdef HAVE_RSEQ
+  useRseq = rseqRegistered();
+#else
+  useRseq = 0;
+#endif
+  return useRseq;
+}
+
+void *percpuPop(int c) {
+  cpuCache *cache;
+  cpuClass *cls;
+  void *item = NULL;
+
+#ifdef HAVE_RSEQ
+  if (useRseq) return rseqPop(c);
+#endif
+  cache = lockCpu();
+  cls = &cache->classes[c];
+  if (cls->count > 0) {
+    item = cls->slots[--cls->count];
+  }
+  pthread_mutex_unlock(&cache->lock);
+  return item;
+}
+
+int percpuPush(int c, void *block) {
+  cpuCache *cache;
+  cpuClass *cls;
+  int pushed = 0;
+
+#ifdef HAVE_RSEQ
+  if (useRseq) return rseqPush(c, block);
+#endif
+  cache = lockCpu();
+  cls = &cache->classes[c];
+  if (cls->count < CPU_SLOTS) {
+    cls->slots[cls->count++] = block;
+    pushed = 1;
+  }
+  pthread_mutex_unlock(&cache->lock);
+  return pushed;
+}
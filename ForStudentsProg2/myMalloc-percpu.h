@@ -0,0 +1,25 @@
+// CSc 422
+// Program 2 header file for the myMalloc per-CPU caches
+
+#ifndef MYMALLOC_PERCPU_H
+#define MYMALLOC_PERCPU_H
+
+// per-CPU caches hold, for each CPU and class, an array of up to CPU_SLOTS free blocks
+// and a count. On x86-64 Linux with rseq registered (glibc 2.35 and later do it for every
+// thread) a thread pops and pushes with restartable sequences: plain loads and stores,
+// committed by the store of the count, and restarted by the kernel if the thread is
+// preempted or migrated before then. Without rseq each CPU's arrays are behind a mutex,
+// and the CPU comes from sched_getcpu
+#define CPU_SLOTS 128
+
+// caches for every configured CPU with numClasses classes each; 1 if they use rseq, 0 if
+// they use the locking fallback, -1 if out of memory. A second call drops the old caches
+int percpuInit(int numClasses);
+
+// a block of class c from the current CPU's cache, or NULL if it has none
+void *percpuPop(int c);
+
+// put block in the current CPU's cache of class c; 0 if that is full
+int percpuPush(int c, void *block);
+
+#endif
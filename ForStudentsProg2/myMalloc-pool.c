@@ -0,0 +1,182 @@
+// CSc 422
+// Program 2 code for myMalloc object pools: slabs of one exact object size, with a cache
+// of free objects per thread in front of a shared list
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+#include "myMalloc-helper.h"
+#include "myMalloc-pages.h"
+#include "myMalloc-pool.h"
+
+#define POOL_BATCH 32          // objects moved between a thread cache and the shared list at a time
+#define POOL_SLAB_OBJECTS 64   // a slab holds at least this many objects, and is at least two pages
+
+// one thread's free objects of one pool; the cache outlives its thread, and goes on the
+// pool's freeCaches for the next new thread to use
+typedef struct poolCache {
+  chunk freeList;              // dummy header
+  int freeCount;
+  myPool *pool;
+  struct poolCache *nextFree;  // link in the pool's list of caches waiting for a thread
+  struct poolCache *nextAll;   // link in the list of every cache of the pool
+} poolCache;
+
+struct myPool {
+  int stride;                  // bytes from one object to the next
+  int perSlab;
+  size_t slabPages;
+  myPoolHook construct;
+  myPoolHook reset;
+  pthread_key_t key;           // the calling thread's cache; its destructor empties it
+  pthread_mutex_t lock;        // held for everything below
+  chunk freeList;              // dummy header of the shared list
+  span *slabs;                 // linked through next, which the page heap only uses for free spans
+  poolCache *freeCaches;
+  poolCache *allCaches;
+};
+
+// thread exit: the cache's objects go to the shared list, and the cache waits for the
+// next thread that uses the pool
+static void releaseCache(void *arg) {
+  poolCache *cache = (poolCache *) arg;
+  myPool *pool = cache->pool;
+
+  pthread_mutex_lock(&pool->lock);
+  moveChunks(&pool->freeList, &cache->freeList);
+  cache->freeCount = 0;
+  cache->nextFree = pool->freeCaches;
+  pool->freeCaches = cache;
+  pthread_mutex_unlock(&pool->lock);
+}
+
+myPool *myPoolCreate(int size, int align, myPoolHook construct, myPoolHook reset) {
+  myPool *pool;
+  int stride;
+
+  if (align == 0) align = sizeof(void *);
+  if (size < (int) sizeof(chunk) || align < 0 || (align & (align - 1)) != 0 || align > (int) PAGE_BYTES) {
+    return NULL;
+  }
+  stride = (size + align - 1) & ~(align - 1);
+  if (stride <= 0) return NULL;
+  pool = malloc(sizeof(myPool));
+  if (!pool) return NULL;
+  if (pthread_key_create(&pool->key, releaseCache) != 0) {
+    free(pool);
+    return NULL;
+  }
+  pool->stride = stride;
+  pool->slabPages = ((size_t) stride * POOL_SLAB_OBJECTS + PAGE_BYTES - 1) >> PAGE_SHIFT;
+  if (pool->slabPages < 2) pool->slabPages = 2;
+  pool->perSlab = (int) (pool->slabPages * PAGE_BYTES / stride);
+  pool->construct = construct;
+  pool->reset = reset;
+  pthread_mutex_init(&pool->lock, NULL);
+  pool->freeList.next = NULL;
+  pool->slabs = NULL;
+  pool->freeCaches = NULL;
+  pool->allCaches = NULL;
+  return pool;
+}
+
+// the calling thread's cache for pool, creating it (or reusing one an exited thread left)
+// the first time; NULL if there is no memory for it
+static poolCache *threadCache(myPool *pool) {
+  poolCache *cache = pthread_getspecific(pool->key);
+  if (cache) return cache;
+  pthread_mutex_lock(&pool->lock);
+  if (pool->freeCaches) {
+    cache = pool->freeCaches;
+    pool->freeCaches = cache->nextFree;
+  } else if ((cache = malloc(sizeof(poolCache))) != NULL) {
+    cache->freeList.next = NULL;
+    cache->freeCount = 0;
+    cache->pool = pool;
+    cache->nextAll = pool->allCaches;
+    pool->allCaches = cache;
+  }
+  pthread_mutex_unlock(&pool->lock);
+  if (cache) pthread_setspecific(pool->key, cache);
+  return cache;
+}
+
+// cache has run dry: take a batch from the shared list, else carve a new slab into the
+// cache; 0 if the page heap is out of memory
+static int refill(myPool *pool, poolCache *cache) {
+  span *slab;
+  int i;
+
+  pthread_mutex_lock(&pool->lock);
+  for (i = 0; i < POOL_BATCH && pool->freeList.next != NULL; i++) {
+    returnChunk(&cache->freeList, getChunk(&pool->freeList));
+  }
+  cache->freeCount += i;
+  if (i == 0 && (slab = pageAlloc(pool->slabPages, SPAN_POOL)) != NULL) {
+    slab->next = pool->slabs;
+    pool->slabs = slab;
+    setUpChunks(&cache->freeList, slab->start, pool->perSlab, pool->stride);
+    cache->freeCount += pool->perSlab;
+  }
+  pthread_mutex_unlock(&pool->lock);
+  return cache->freeCount > 0;
+}
+
+void *myPoolAlloc(myPool *pool) {
+  poolCache *cache = threadCache(pool);
+  chunk *object;
+
+  if (!cache || (cache->freeList.next == NULL && !refill(pool, cache))) {
+    return NULL;
+  }
+  object = getChunk(&cache->freeList);
+  cache->freeCount--;
+  if (pool->construct) pool->construct(object);
+  return object;
+}
+
+void myPoolFree(myPool *pool, void *object) {
+  poolCache *cache;
+  int i;
+
+  if (!object) {
+    return;
+  }
+  if (pool->reset) pool->reset(object);
+  cache = threadCache(pool);
+  if (!cache) {
+    // no cache, and no memory for one: straight to the shared list
+    pthread_mutex_lock(&pool->lock);
+    returnChunk(&pool->freeList, (chunk *) object);
+    pthread_mutex_unlock(&pool->lock);
+    return;
+  }
+  returnChunk(&cache->freeList, (chunk *) object);
+  // past two batches, one goes back for other threads
+  if (++cache->freeCount > 2 * POOL_BATCH) {
+    pthread_mutex_lock(&pool->lock);
+    for (i = 0; i < POOL_BATCH; i++) {
+      returnChunk(&pool->freeList, getChunk(&cache->freeList));
+    }
+    pthread_mutex_unlock(&pool->lock);
+    cache->freeCount -= POOL_BATCH;
+  }
+}
+
+void myPoolDestroy(myPool *pool) {
+  span *slab, *next;
+  poolCache *cache, *nextCache;
+
+  // with the key gone, exiting threads no longer touch their caches
+  pthread_key_delete(pool->key);
+  for (slab = pool->slabs; slab; slab = next) {
+    next = slab->next;
+    pageFree(slab);
+  }
+  for (cache = pool->allCaches; cache; cache = nextCache) {
+    nextCache = cache->nextAll;
+    free(cache);
+  }
+  pthread_mutex_destroy(&pool->lock);
+  free(pool);
+}
@@ -0,0 +1,32 @@
+// CSc 422
+// Program 2 header file for myMalloc object pools
+
+#ifndef MYMALLOC_POOL_H
+#define MYMALLOC_POOL_H
+
+// a pool hands out objects of one size and alignment from page-heap slabs of its own,
+// packed at exactly that size (rounded up only to the alignment) instead of the next size
+// class. Each thread keeps a cache of free objects per pool, so myPoolAlloc and myPoolFree
+// are a pop and a push; caches trade objects with the pool's shared list a batch at a
+// time, under the pool's lock, and hand all of theirs back when their thread exits. Any
+// thread may free an object, which goes to its own cache. Pools work with or without
+// myInit, and their objects must not be given to myFree
+typedef struct myPool myPool;
+
+typedef void (*myPoolHook)(void *object);
+
+// a pool of size-byte objects aligned to align, a power of two up to the page size (0 for
+// the alignment of a pointer); free objects hold a pointer, so size is at least that. If
+// not NULL, construct runs on every object myPoolAlloc hands out, and reset on every
+// object given to myPoolFree. NULL if the size or alignment is invalid or memory runs out
+myPool *myPoolCreate(int size, int align, myPoolHook construct, myPoolHook reset);
+
+// an object from pool, or NULL if memory runs out
+void *myPoolAlloc(myPool *pool);
+void myPoolFree(myPool *pool, void *object);
+
+// give the pool's slabs back to the page heap; no thread may use the pool or its objects
+// afterwards
+void myPoolDestroy(myPool *pool);
+
+#endif
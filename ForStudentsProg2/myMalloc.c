@@ -1,213 +1,1096 @@
 // CSc 422
-// Program 2 code for sequential myMalloc (small blocks *only*)
-// You must add support for large blocks and then concurrency (coarse- and fine-grain)
+// Program 2 code for myMalloc: segregated size classes up to 1024 bytes, and the page
+// buddy tier (myMalloc-buddy.c) up to 16 KB and the page heap (myMalloc-pages.c) for
+// anything bigger
+// sequential (flag 0), coarse-grain (flag 1), fine-grain (flag 2) and per-CPU (flag 3)
+// concurrency
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdint.h>
+#include <string.h>
 #include <pthread.h>
-#include "myMalloc-helper.h"
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include "myMalloc.h"
+#include "myMalloc-percpu.h"
+#include "myMalloc-buddy.h"
 
-// total amount of memory to allocate
-#define SIZE_TOTAL 276672
-#define SIZE_SMALL 64
-#define MAX_THREADS 8
-#define SIZE_OVERFLOW SIZE_TOTAL
+#if BUDDY_ORDERS != MYMALLOC_BUDDY_ORDERS
+#error "myMalloc.h and myMalloc-buddy.h disagree on the buddy orders"
+#endif
 
-// maintain lists of free blocks and allocated blocks
+// defaults for myInit; myInitWithConfig takes these at runtime
+#define DEFAULT_SLAB_SIZE 8192        // slabs come from the page heap and hold blocks of one class
+#define DEFAULT_THREAD_LIMIT 0        // bytes of slabs per thread heap, 0 for no limit
+#define DEFAULT_OVERFLOW_LIMIT 0      // bytes of slabs in the shared overflow pool
+
+// thread caches move blocks to and from the overflow pool in batches, whose size per
+// class adapts between these bounds to how often the class runs dry
+#define MIN_BATCH 8
+#define START_BATCH 16
+#define MAX_BATCH 256
+
+// per-CPU caches (flag 3) refill from and spill to the overflow pool this many at a time
+#define CPU_BATCH (CPU_SLOTS / 2)
+
+// size classes: 16-byte steps up to 128, then four classes per doubling, so no class is
+// more than 25% bigger than the one below it (past the first few)
+#define NUM_CLASSES MYMALLOC_CLASSES
+#define MAX_SMALL MYMALLOC_MAX_SMALL
+
+static const int classSizes[NUM_CLASSES] = {
+  16, 32, 48, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384, 448, 512, 640, 768, 896, 1024
+};
+
+// class for every request size, indexed by (size + 15) / 16, filled in by myInit
+unsigned char myMallocSizeClass[MAX_SMALL / 16 + 1];
+
+// statistics each heap keeps for the thread that owns it, in the heap's own cache lines,
+// with one set of counters per class, per buddy order and for blocks above 16 KB; the
+// cache counts mallocs, frees and the bytes asked for. Bytes in use follow from those
+// counts for the size classes and buddy orders; the slow paths add this heap's change
+// since they last did to bytesInUse
+#define STATS_CLASSES MYMALLOC_STAT_CLASSES
+#define BUDDY_CLASS NUM_CLASSES
+#define LARGE_CLASS (NUM_CLASSES + BUDDY_ORDERS)
+
+typedef struct classCounters {
+  long overflowHits;   // blocks taken from the overflow pool
+  long remoteFrees;    // frees of blocks owned by another thread's heap
+} classCounters;
+
+typedef struct heapStats {
+  classCounters classes[STATS_CLASSES];
+  long largeBytes;     // change in bytes of large blocks in use from this heap
+  long flushedBytes;   // this heap's bytes in use as last added to bytesInUse
+} __attribute__((aligned(64))) heapStats;
+
+// maintain lists of free blocks per class, in the cache that myMalloc.h's fast paths
+// use; blocks carry no header, since the page map gives the class and owning manager of
+// the slab any block lives in. Only the owning thread touches the cache; other threads
+// free its blocks onto remoteFree, which the owner moves to the cache when a class runs
+// dry. The cache comes first, so a slab's owner is also the address of its cache
 typedef struct memoryManager {
-  chunk *freeSmall;
-  chunk *allocSmall;
-  chunk *freeLarge;
-  chunk *allocLarge;
-  void *startLargeMem;  // start of large block memory for pointer checks
-  void *endLargeMem;
+  myMallocCache cache;
+  chunk *remoteFree[NUM_CLASSES];
+  int batch[NUM_CLASSES];         // blocks per refill from, or release to, the overflow pool
+  long refillAllocs[NUM_CLASSES]; // cache.allocs when the class last ran dry
+  long slabBytes;      // bytes of slabs taken from the page heap so far
+  long limit;          // most slab bytes this manager may hold, 0 for no limit, -1 for none
+  struct memoryManager *nextHeap;  // link in the list of heaps waiting for a new thread
+  struct memoryManager *nextAll;   // link in the list of every heap, for myMallocStats
+  int id;              // heaps are numbered from 0 in the order they are created
+  int exited;          // 1 from the time its thread exits until another thread takes it
+  heapStats stats;
 } memManager;
 
 // Thread-local keys and global structures
-static memManager *threadManagers[MAX_THREADS+1];     // 1 per thread
 static memManager *overflowManager;
-static pthread_mutex_t overflowLockSmall = PTHREAD_MUTEX_INITIALIZER;
-static pthread_mutex_t overflowLockLarge = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t overflowLocks[NUM_CLASSES];  // one per class
+static pthread_mutex_t overflowSlabLock = PTHREAD_MUTEX_INITIALIZER;
+
+// the shared overflow pool keeps its free blocks in Treiber stacks, two per class: top
+// holds single blocks, and batches holds whole chains of blocks handed back by thread
+// caches, linked through the second word of each chain's first block. A top is a block
+// pointer with a 16-bit generation in the upper bits, which user-space addresses leave
+// unused. Every push and pop bumps the generation, so a pop whose top was popped and
+// pushed back meanwhile (ABA) fails its compare-and-swap. With lockedOverflow set, the
+// overflow manager's free lists behind overflowLocks are used instead. Each class has a
+// cache line of its own, and counts its operations and contention
+#define STACK_PTR_MASK (((uintptr_t) 1 << 48) - 1)
+#define STACK_TAG_ONE ((uintptr_t) 1 << 48)
+#define LINK_NEXT 0     // word of a block that links it on top (and within a batch)
+#define LINK_BATCH 1    // word of a batch's first block that links it on batches
+
+typedef struct overflowStack {
+  uintptr_t top;
+  uintptr_t batches;
+  long ops;        // pushes and pops
+  long retries;    // failed compare-and-swaps, or lock attempts that found the lock held
+} __attribute__((aligned(64))) overflowStack;
+
+static overflowStack overflowStacks[NUM_CLASSES];
+static int lockedOverflow = 0;
 
+// thread heaps are created the first time a thread calls myMalloc or myFree, and go on
+// freeHeaps when their thread exits so that the next new thread can reuse them. A thread
+// finds its heap through threadHeap, and its cache through myMallocThreadCache (left NULL
+// in coarse mode and debug builds, to keep every call off the fast paths); threadKey is
+// only there for its destructor
+__thread myMallocCache *myMallocThreadCache __attribute__((tls_model("initial-exec")));
+static __thread memManager *threadHeap __attribute__((tls_model("initial-exec")));
 static pthread_key_t threadKey;
-static int threadCount;
+static int threadKeyCreated = 0;
+static memManager *freeHeaps;
+static int heapCount;                 // heaps created since myInit
+static memManager *allHeaps;
 static pthread_mutex_t idAssignLock = PTHREAD_MUTEX_INITIALIZER;
 static int globalMode = 0;
+static int slabSize = DEFAULT_SLAB_SIZE;
+static long threadLimit = DEFAULT_THREAD_LIMIT;
 
-int myInit(int numCores, int flag) {
-  globalMode = flag;
-  threadCount = 0;
-  overflowManager = NULL;
-  // Create thread-local key
-  pthread_key_create(&threadKey, NULL);
+// shared statistics, updated atomically: bytes in use as of the last flush from each heap,
+// and the slab bytes carved for each class (slabs are never given back)
+static long bytesInUse;
+static long peakBytesInUse;
+static long classSlabBytes[NUM_CLASSES];
 
-  void *overflowMem = malloc(SIZE_OVERFLOW);
-  if (!overflowMem) return -1;
+// set the batch size of mgr's class c, and with it the high-water mark: four batches, or
+// one slab if that is more
+static void setBatch(memManager *mgr, int c, int batch) {
+  int perSlab = slabSize / classSizes[c];
+  mgr->batch[c] = batch;
+  mgr->cache.highWater[c] = (4 * batch > perSlab) ? 4 * batch : perSlab;
+}
 
-  overflowManager = malloc(sizeof(memManager));
-  overflowManager->freeSmall = createList();
-  overflowManager->allocSmall = createList();
-  overflowManager->freeLarge = createList();
-  overflowManager->allocLarge = createList();
+// a manager that may take up to limit bytes of slabs, with empty lists; it starts on a
+// cache line, so that its stats have lines of their own
+static memManager *createManager(long limit) {
+  int c;
+  memManager *mgr;
+  if (posix_memalign((void **) &mgr, 64, sizeof(memManager)) != 0) return NULL;
+  memset(&mgr->cache, 0, sizeof(myMallocCache));
+  for (c = 0; c < NUM_CLASSES; c++) {
+    mgr->cache.freeList[c] = createList();
+    mgr->remoteFree[c] = NULL;
+    setBatch(mgr, c, START_BATCH);
+    mgr->refillAllocs[c] = 0;
+  }
+  mgr->slabBytes = 0;
+  mgr->limit = limit;
+  mgr->nextHeap = NULL;
+  mgr->nextAll = NULL;
+  mgr->id = -1;
+  mgr->exited = 0;
+  memset(&mgr->stats, 0, sizeof(heapStats));
+  return mgr;
+}
 
-  int numSmallOverflow = (SIZE_OVERFLOW / 2) / (SIZE_SMALL + sizeof(chunk));
-  int numLargeOverflow = (SIZE_OVERFLOW / 2) / (1024 + sizeof(chunk));
-  void *overflowSmallMem = overflowMem;
-  void *overflowLargeMem = (char *)overflowMem + SIZE_OVERFLOW / 2;
+// grow mgr by a new slab of class c from the page heap; 0 if that would pass its limit
+static int newSlab(memManager *mgr, int c) {
+  int blockSize = classSizes[c];
+  span *slab;
+  if (mgr->limit != 0 && mgr->slabBytes + slabSize > mgr->limit) return 0;
+  slab = pageAlloc(slabSize / PAGE_BYTES, SPAN_SLAB);
+  if (!slab) return 0;
+  slab->sizeClass = c;
+  slab->owner = mgr;
+#ifdef MYMALLOC_DEBUG
+  slab->live = calloc((slabSize / blockSize + 7) / 8, 1);
+  if (!slab->live) {
+    pageFree(slab);
+    return 0;
+  }
+#endif
+  setUpChunks(mgr->cache.freeList[c], slab->start, slabSize / blockSize, blockSize);
+  mgr->cache.freeCount[c] += slabSize / blockSize;
+  mgr->slabBytes += slabSize;
+  __atomic_fetch_add(&classSlabBytes[c], slabSize, __ATOMIC_RELAXED);
+  return 1;
+}
 
-  setUpChunks(overflowManager->freeSmall, overflowSmallMem, numSmallOverflow, SIZE_SMALL);
-  setUpChunks(overflowManager->freeLarge, overflowLargeMem, numLargeOverflow, 1024);
+// move the blocks other threads have freed to mgr's class c onto its free list; 0 if
+// there were none
+static int drainRemote(memManager *mgr, int c) {
+  chunk remote;
+  remote.next = remoteTakeAll(&mgr->remoteFree[c]);
+  if (!remote.next) return 0;
+  mgr->cache.freeCount[c] += moveChunks(mgr->cache.freeList[c], &remote);
+  return 1;
+}
 
-  overflowManager->startLargeMem = overflowLargeMem;
-  overflowManager->endLargeMem = (char *)overflowLargeMem + numLargeOverflow * (1024 + sizeof(chunk));
-  int numToInit = (flag == 0) ? 1 : numCores+1;
+#ifdef MYMALLOC_DEBUG
+// debug builds (-DMYMALLOC_DEBUG) still track live blocks, with one bit per block in each
+// slab: myFree rejects pointers that are not the start of a live block, and
+// myMallocLiveBlocks reports how many are allocated
+static long liveBlocks = 0;
 
-  for (int i = 0; i < numToInit; i++) {
-    threadManagers[i] = malloc(sizeof(memManager));
+static void markLive(void *ptr) {
+  span *s = spanOf(ptr);
+  size_t index = ((char *)ptr - s->start) / classSizes[s->sizeClass];
+  __atomic_fetch_or(&s->live[index / 8], (unsigned char) (1 << (index % 8)), __ATOMIC_RELAXED);
+  __atomic_fetch_add(&liveBlocks, 1, __ATOMIC_RELAXED);
+}
 
-    if (flag == 1) {
-        // Coarse-grained: zero-sized lists (force overflow use)
-        threadManagers[i]->freeSmall = createList();
-        threadManagers[i]->allocSmall = createList();
-        threadManagers[i]->freeLarge = createList();
-        threadManagers[i]->allocLarge = createList();
-        continue;
-    }
+// 1 if ptr was a live block of slab s and is now marked free, 0 if it must not be freed
+static int markFree(span *s, void *ptr) {
+  size_t offset = (char *)ptr - s->start;
+  size_t index = offset / classSizes[s->sizeClass];
+  unsigned char bit = 1 << (index % 8);
+  if (offset % classSizes[s->sizeClass] != 0) {
+    fprintf(stderr, "myFree: %p is not the start of a block\n", ptr);
+    return 0;
+  }
+  if (!(__atomic_fetch_and(&s->live[index / 8], (unsigned char) ~bit, __ATOMIC_RELAXED) & bit)) {
+    fprintf(stderr, "myFree: %p is not allocated (double free?)\n", ptr);
+    return 0;
+  }
+  __atomic_fetch_sub(&liveBlocks, 1, __ATOMIC_RELAXED);
+  return 1;
+}
+#endif
 
-    // Fine-grained or single-threaded: allocate per-thread pool
-    void *mem = malloc(SIZE_TOTAL);
-    if (!mem) return -1;
-    threadManagers[i]->freeSmall = createList();
-    threadManagers[i]->allocSmall = createList();
-    threadManagers[i]->freeLarge = createList();
-    threadManagers[i]->allocLarge = createList();
+long myMallocLiveBlocks() {
+#ifdef MYMALLOC_DEBUG
+  return __atomic_load_n(&liveBlocks, __ATOMIC_RELAXED);
+#else
+  return -1;
+#endif
+}
 
-    int numSmall = (SIZE_TOTAL / 2) / (SIZE_SMALL + sizeof(chunk));
-    int numLarge = (SIZE_TOTAL / 2) / (1024 + sizeof(chunk));
+static void releaseThreadManager(void *arg);
 
-    void *memSmall = mem;
-    void *memLarge = (char *)mem + SIZE_TOTAL / 2;
+// numCores is only a hint now: any number of threads may use myMalloc, each with a heap
+// of its own (or, in coarse mode, sharing the overflow pool)
+int myInit(int numCores, int flag) {
+  return myInitWithConfig(numCores, flag, NULL);
+}
 
-    setUpChunks(threadManagers[i]->freeSmall, memSmall, numSmall, SIZE_SMALL);
-    setUpChunks(threadManagers[i]->freeLarge, memLarge, numLarge, 1024);
+int myInitWithConfig(int numCores, int flag, const myMallocConfig *config) {
+  int i, c;
+  long overflowLimit = DEFAULT_OVERFLOW_LIMIT;
 
-    threadManagers[i]->startLargeMem = memLarge;
-    threadManagers[i]->endLargeMem = (char *)memLarge + numLarge * (1024 + sizeof(chunk));
+  slabSize = DEFAULT_SLAB_SIZE;
+  threadLimit = DEFAULT_THREAD_LIMIT;
+  lockedOverflow = 0;
+  if (config) {
+    if (config->slabSize < (int) PAGE_BYTES || config->slabSize % PAGE_BYTES != 0 ||
+        config->threadHeapLimit < 0 || config->overflowLimit < 0) {
+      return -1;
+    }
+    slabSize = config->slabSize;
+    threadLimit = config->threadHeapLimit;
+    overflowLimit = config->overflowLimit;
+    lockedOverflow = config->lockedOverflow;
   }
-  
+  globalMode = flag;
+  freeHeaps = NULL;
+  heapCount = 0;
+  allHeaps = NULL;
+  bytesInUse = peakBytesInUse = 0;
+  overflowManager = NULL;
+  threadHeap = NULL;
+  myMallocThreadCache = NULL;
+  // Create thread-local key; heaps of an earlier myInit are abandoned with the old key
+  if (threadKeyCreated) {
+    pthread_key_delete(threadKey);
+  }
+  if (pthread_key_create(&threadKey, releaseThreadManager) != 0) return -1;
+  threadKeyCreated = 1;
+
+  for (i = 0, c = 0; i <= MAX_SMALL / 16; i++) {
+    while (classSizes[c] < i * 16) c++;
+    myMallocSizeClass[i] = c;
+  }
+  for (c = 0; c < NUM_CLASSES; c++) {
+    pthread_mutex_init(&overflowLocks[c], NULL);
+    overflowStacks[c].top = 0;
+    overflowStacks[c].batches = 0;
+    overflowStacks[c].ops = 0;
+    overflowStacks[c].retries = 0;
+    classSlabBytes[c] = 0;
+  }
+
+  overflowManager = createManager(overflowLimit);
+  if (!overflowManager) return -1;
+  if (flag == 3 && percpuInit(NUM_CLASSES) < 0) return -1;
+
   return 0;
 }
 
 // empty list check
 static int isEmptyList(chunk *list) {
-  return (list->next == list);
+  return (list->next == NULL);
 }
 
-void assignThreadManager() {
-  void *current = pthread_getspecific(threadKey);
-  if (current != NULL) return;
+// the calling thread's heap: the one it already has, else one left by an exited thread,
+// else a new one; NULL if there is no memory for a new one
+static memManager *assignThreadManager() {
+  memManager *mgr = threadHeap;
+  if (mgr != NULL) return mgr;
   pthread_mutex_lock(&idAssignLock);
-  int id = threadCount;
-  // printf("Thread assigned ID %d\n", id);
-  if (id >= MAX_THREADS) {
-      // fprintf(stderr, "Error: too many threads\n");
-      exit(1);
+  if (freeHeaps) {
+    mgr = freeHeaps;
+    freeHeaps = mgr->nextHeap;
+    __atomic_store_n(&mgr->exited, 0, __ATOMIC_RELAXED);
+  } else {
+    // Coarse-grained: no slabs of its own (force overflow use); per-CPU: none either,
+    // the heap only keeps the thread's statistics; fine-grained or single-threaded: a
+    // per-thread heap that grows a slab at a time
+    mgr = createManager((globalMode == 1 || globalMode == 3) ? -1 : threadLimit);
+    if (mgr) {
+      mgr->id = heapCount++;
+      mgr->nextAll = allHeaps;
+      allHeaps = mgr;
+    }
   }
-  memManager *mgr = threadManagers[id];
-  if (!mgr) {
-      // fprintf(stderr, "threadManagers[%d] is NULL!\n", id);
-      exit(1);
-  }
-  pthread_setspecific(threadKey, mgr);
-  threadCount++;
-  // First-time touch for output file
-  char str[32];
-  snprintf(str, sizeof(str), "touch Id-%d\n", id + 1);
-  system(str);
   pthread_mutex_unlock(&idAssignLock);
+  if (mgr) {
+    pthread_setspecific(threadKey, mgr);
+    threadHeap = mgr;
+#ifndef MYMALLOC_DEBUG
+    if (mgr->limit >= 0) myMallocThreadCache = &mgr->cache;
+#endif
+  }
+  return mgr;
 }
 
-// myMalloc just needs to get the next chunk and return a pointer to its data
-// note the pointer arithmetic that makes sure to skip over our metadata and
-// return the user a pointer to the data
-void *myMalloc(int size) {
-  if (size > 1024) {
+// the block size of statistics class c; 0 for blocks above 16 KB, which vary
+static long statBlockSize(int c) {
+  if (c < NUM_CLASSES) return classSizes[c];
+  if (c < LARGE_CLASS) return (long) 1 << (BUDDY_MIN_SHIFT + c - BUDDY_CLASS);
+  return 0;
+}
+
+// bytes in use through mgr: its mallocs less its frees, which may be negative
+static long heapBytesInUse(memManager *mgr) {
+  long bytes = mgr->stats.largeBytes;
+  int c;
+  for (c = 0; c < LARGE_CLASS; c++) {
+    bytes += (mgr->cache.allocs[c] - mgr->cache.frees[c]) * statBlockSize(c);
+  }
+  return bytes;
+}
+
+// add mgr's change in bytes in use since the last flush to the shared total, raising the
+// peak if need be
+static void flushInUse(memManager *mgr) {
+  long bytes = heapBytesInUse(mgr);
+  long now = __atomic_add_fetch(&bytesInUse, bytes - mgr->stats.flushedBytes, __ATOMIC_RELAXED);
+  long peak = __atomic_load_n(&peakBytesInUse, __ATOMIC_RELAXED);
+  mgr->stats.flushedBytes = bytes;
+  while (now > peak && !__atomic_compare_exchange_n(&peakBytesInUse, &peak, now, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+// overflow stack routines; link is the word of a block that points to the one below it
+
+// pop the top block of *top, a stack of st, or NULL if it is empty
+static chunk *stackPop(overflowStack *st, uintptr_t *top, int link) {
+  uintptr_t old = __atomic_load_n(top, __ATOMIC_ACQUIRE), next;
+  chunk *item;
+  long retries = 0;
+  do {
+    item = (chunk *) (old & STACK_PTR_MASK);
+    if (!item) break;
+    // another thread may pop item and hand it out before the compare-and-swap, which
+    // then fails; reading its first bytes meanwhile is safe, since slabs stay mapped
+    next = (uintptr_t) __atomic_load_n(&((chunk **) item)[link], __ATOMIC_RELAXED) | ((old + STACK_TAG_ONE) & ~STACK_PTR_MASK);
+  } while (!__atomic_compare_exchange_n(top, &old, next, 1, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE) && ++retries);
+  __atomic_fetch_add(&st->ops, 1, __ATOMIC_RELAXED);
+  if (retries) __atomic_fetch_add(&st->retries, retries, __ATOMIC_RELAXED);
+  return item;
+}
+
+// push the blocks from first to last, already linked, onto *top in one step
+static void stackPush(overflowStack *st, uintptr_t *top, chunk *first, chunk *last, int link) {
+  uintptr_t old = __atomic_load_n(top, __ATOMIC_RELAXED), next;
+  long retries = 0;
+  do {
+    ((chunk **) last)[link] = (chunk *) (old & STACK_PTR_MASK);
+    next = (uintptr_t) first | ((old + STACK_TAG_ONE) & ~STACK_PTR_MASK);
+  } while (!__atomic_compare_exchange_n(top, &old, next, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED) && ++retries);
+  __atomic_fetch_add(&st->ops, 1, __ATOMIC_RELAXED);
+  if (retries) __atomic_fetch_add(&st->retries, retries, __ATOMIC_RELAXED);
+}
+
+// empty *top, a stack of st, in one step and return its blocks, still linked
+static chunk *stackTakeAll(overflowStack *st, uintptr_t *top) {
+  uintptr_t old = __atomic_load_n(top, __ATOMIC_ACQUIRE);
+  long retries = 0;
+  while ((old & STACK_PTR_MASK) &&
+         !__atomic_compare_exchange_n(top, &old, (old + STACK_TAG_ONE) & ~STACK_PTR_MASK, 1, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)) {
+    retries++;
+  }
+  __atomic_fetch_add(&st->ops, 1, __ATOMIC_RELAXED);
+  if (retries) __atomic_fetch_add(&st->retries, retries, __ATOMIC_RELAXED);
+  return (chunk *) (old & STACK_PTR_MASK);
+}
+
+// end of overflow stack routines
+
+// lock class c of the locked overflow pool, counting the times it was already held
+static void overflowLock(int c) {
+  if (pthread_mutex_trylock(&overflowLocks[c]) != 0) {
+    __atomic_fetch_add(&overflowStacks[c].retries, 1, __ATOMIC_RELAXED);
+    pthread_mutex_lock(&overflowLocks[c]);
+  }
+  __atomic_fetch_add(&overflowStacks[c].ops, 1, __ATOMIC_RELAXED);
+}
+
+// return one block of class c to the overflow pool
+static void overflowReturn(int c, chunk *item) {
+  if (lockedOverflow) {
+    overflowLock(c);
+    returnChunk(overflowManager->cache.freeList[c], item);
+    pthread_mutex_unlock(&overflowLocks[c]);
+  } else {
+    stackPush(&overflowStacks[c], &overflowStacks[c].top, item, item, LINK_NEXT);
+  }
+}
+
+// move every block on list, of class c, to the overflow pool as one batch
+static void overflowReturnList(int c, chunk *list) {
+  if (isEmptyList(list)) return;
+  if (lockedOverflow) {
+    overflowLock(c);
+    moveChunks(overflowManager->cache.freeList[c], list);
+    pthread_mutex_unlock(&overflowLocks[c]);
+    return;
+  }
+  stackPush(&overflowStacks[c], &overflowStacks[c].batches, list->next, list->next, LINK_BATCH);
+  list->next = NULL;
+}
+
+// move up to n blocks of class c from the overflow pool to list, in one operation when a
+// batch is waiting; returns how many moved, which may be more than n for a batch. With no
+// batch waiting, the single blocks on top come off all at once: the first n are kept and
+// the rest go back as a batch, so a refill costs at most three operations, not n
+static int overflowTake(int c, chunk *list, int n) {
+  overflowStack *st = &overflowStacks[c];
+  chunk taken, *last;
+  int count;
+
+  taken.next = NULL;
+  if (lockedOverflow) {
+    chunk *pool = overflowManager->cache.freeList[c];
+    overflowLock(c);
+    for (count = 0; count < n && !isEmptyList(pool); count++) {
+      returnChunk(&taken, getChunk(pool));
+    }
+    pthread_mutex_unlock(&overflowLocks[c]);
+  } else if ((taken.next = stackPop(st, &st->batches, LINK_BATCH)) == NULL &&
+             (taken.next = stackTakeAll(st, &st->top)) != NULL) {
+    for (last = taken.next, count = 1; count < n && last->next; count++) {
+      last = last->next;
+    }
+    if (last->next) {
+      stackPush(st, &st->batches, last->next, last->next, LINK_BATCH);
+      last->next = NULL;
+    }
+  }
+  return moveChunks(list, &taken);
+}
+
+// give the older half of mgr's blocks of class c back to the overflow pool once the list
+// passes its high-water mark
+static void releaseSurplus(memManager *mgr, int c) {
+  chunk surplus, *last;
+  int i, keep;
+
+  if (mgr->cache.freeCount[c] <= mgr->cache.highWater[c]) return;
+  // surplus blocks sit idle here, so move fewer at a time from now on
+  if (mgr->batch[c] > MIN_BATCH) setBatch(mgr, c, mgr->batch[c] / 2);
+  keep = mgr->cache.freeCount[c] - mgr->cache.freeCount[c] / 2;
+  last = mgr->cache.freeList[c]->next;
+  for (i = 1; i < keep; i++) {
+    last = last->next;
+  }
+  surplus.next = last->next;
+  last->next = NULL;
+  mgr->cache.freeCount[c] = keep;
+  overflowReturnList(c, &surplus);
+  flushInUse(mgr);
+}
+
+// mgr's class c has run dry: take the blocks other threads have freed to it, else a
+// batch from the overflow pool, else a new slab; 0 if all of those are empty. Coarse
+// mode heaps keep no blocks, so they go straight to the overflow pool instead
+static int refill(memManager *mgr, int c) {
+  if (drainRemote(mgr, c)) return 1;
+  if (mgr->limit < 0) return 0;
+  // a class that ran dry soon after its last refill wants bigger batches, one that took
+  // a long time to use a batch smaller ones
+  long sinceRefill = mgr->cache.allocs[c] - mgr->refillAllocs[c];
+  if (sinceRefill <= 2 * mgr->batch[c]) {
+    if (mgr->batch[c] < MAX_BATCH) setBatch(mgr, c, mgr->batch[c] * 2);
+  } else if (sinceRefill > 16 * mgr->batch[c]) {
+    if (mgr->batch[c] > MIN_BATCH) setBatch(mgr, c, mgr->batch[c] / 2);
+  }
+  mgr->refillAllocs[c] = mgr->cache.allocs[c];
+  flushInUse(mgr);
+  int taken = overflowTake(c, mgr->cache.freeList[c], mgr->batch[c]);
+  mgr->cache.freeCount[c] += taken;
+  mgr->stats.classes[c].overflowHits += taken;
+  return mgr->cache.freeCount[c] > 0 || newSlab(mgr, c);
+}
+
+void myMallocOverflowContention(long *ops, long *retries) {
+  int c;
+  *ops = *retries = 0;
+  for (c = 0; c < NUM_CLASSES; c++) {
+    *ops += __atomic_load_n(&overflowStacks[c].ops, __ATOMIC_RELAXED);
+    *retries += __atomic_load_n(&overflowStacks[c].retries, __ATOMIC_RELAXED);
+  }
+}
+
+// thread exit: hand the heap's free blocks to the overflow pool, where every thread can
+// get at them, and keep the emptied heap for the next new thread. The heap's slabs now
+// feed the overflow pool, so the heap starts again from no slabs against its limit
+static void releaseThreadManager(void *arg) {
+  memManager *mgr = (memManager *) arg;
+  int c;
+  // from here on, remoteFreeList sends blocks freed to this heap on to the overflow pool;
+  // the fences pair with the one there, so each block pushed meanwhile is drained below
+  // or by its freeing thread
+  __atomic_store_n(&mgr->exited, 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  for (c = 0; c < NUM_CLASSES; c++) {
+    drainRemote(mgr, c);
+    overflowReturnList(c, mgr->cache.freeList[c]);
+    mgr->cache.freeCount[c] = 0;
+    setBatch(mgr, c, START_BATCH);
+    mgr->refillAllocs[c] = mgr->cache.allocs[c];
+  }
+  flushInUse(mgr);
+  threadHeap = NULL;
+  myMallocThreadCache = NULL;
+  pthread_mutex_lock(&idAssignLock);
+  mgr->slabBytes = 0;
+  mgr->nextHeap = freeHeaps;
+  freeHeaps = mgr;
+  pthread_mutex_unlock(&idAssignLock);
+}
+
+// take a block of class c from the shared overflow pool, carving a new slab if needed
+static chunk *overflowChunk(int c) {
+  chunk *toAlloc = NULL;
+  if (lockedOverflow) {
+    overflowLock(c);
+    if (isEmptyList(overflowManager->cache.freeList[c])) {
+        pthread_mutex_lock(&overflowSlabLock);
+        newSlab(overflowManager, c);
+        pthread_mutex_unlock(&overflowSlabLock);
+    }
+    if (!isEmptyList(overflowManager->cache.freeList[c])) {
+        toAlloc = getChunk(overflowManager->cache.freeList[c]);
+    }
+    pthread_mutex_unlock(&overflowLocks[c]);
+  } else {
+    overflowStack *st = &overflowStacks[c];
+    toAlloc = stackPop(st, &st->top, LINK_NEXT);
+    if (!toAlloc && (toAlloc = stackPop(st, &st->batches, LINK_BATCH)) != NULL && toAlloc->next) {
+        // break up a batch: the rest of it goes on top
+        chunk *last = toAlloc->next;
+        while (last->next) {
+            last = last->next;
+        }
+        stackPush(st, &st->top, toAlloc->next, last, LINK_NEXT);
+    }
+    if (!toAlloc) {
+        // the overflow manager's free list only stages a new slab on its way to a stack
+        pthread_mutex_lock(&overflowSlabLock);
+        toAlloc = stackPop(st, &st->top, LINK_NEXT);
+        if (!toAlloc && newSlab(overflowManager, c)) {
+            toAlloc = getChunk(overflowManager->cache.freeList[c]);
+            overflowReturnList(c, overflowManager->cache.freeList[c]);
+        }
+        pthread_mutex_unlock(&overflowSlabLock);
+    }
+  }
+  return toAlloc;
+}
+
+// per-CPU mode: a block of class c from this CPU's cache, which refills with a batch from
+// the overflow pool and keeps what of it fits
+static chunk *cpuChunk(memManager *mgr, int c) {
+  chunk batch, *toAlloc = percpuPop(c);
+  int taken;
+
+  if (toAlloc) return toAlloc;
+  batch.next = NULL;
+  taken = overflowTake(c, &batch, CPU_BATCH);
+  mgr->stats.classes[c].overflowHits += taken;
+  if (taken == 0) {
+    toAlloc = overflowChunk(c);
+    if (toAlloc) mgr->stats.classes[c].overflowHits++;
+    return toAlloc;
+  }
+  toAlloc = getChunk(&batch);
+  while (!isEmptyList(&batch)) {
+    chunk *block = getChunk(&batch);
+    if (!percpuPush(c, block)) {
+      returnChunk(&batch, block);
+      break;
+    }
+  }
+  overflowReturnList(c, &batch);
+  return toAlloc;
+}
+
+// per-CPU mode: return a block of class c to this CPU's cache; if that is full, half of
+// it goes back to the overflow pool first
+static void cpuReturn(int c, chunk *block) {
+  chunk surplus, *item;
+  int i;
+
+  if (percpuPush(c, block)) return;
+  surplus.next = NULL;
+  for (i = 0; i < CPU_BATCH && (item = percpuPop(c)) != NULL; i++) {
+    returnChunk(&surplus, item);
+  }
+  overflowReturnList(c, &surplus);
+  if (!percpuPush(c, block)) {
+    overflowReturn(c, block);
+  }
+}
+
+// myMalloc just needs to get the next free block of the request's class; the block has
+// no header, so the chunk pointer is the user's pointer. This is the slow path of the
+// inline myMalloc in myMalloc.h
+void *myMallocSlow(int size) {
+  if (size < 0) {
     return NULL;
-  } 
-  assignThreadManager();
-  memManager *mgr = (memManager *) pthread_getspecific(threadKey);
+  }
+  memManager *mgr = assignThreadManager();
+  if (size > MAX_SMALL && size <= BUDDY_MAX_BYTES) {
+    int order = buddyOrder(size);
+    void *block = buddyAlloc(order);
+    if (block && mgr) {
+      mgr->cache.allocs[BUDDY_CLASS + order]++;
+      mgr->cache.requested[BUDDY_CLASS + order] += size;
+      flushInUse(mgr);
+    }
+    return block;
+  }
+  if (size > MAX_SMALL) {
+    void *block = largeAlloc(size);
+    if (block && mgr) {
+      mgr->cache.allocs[LARGE_CLASS]++;
+      mgr->cache.requested[LARGE_CLASS] += size;
+      mgr->stats.largeBytes += spanOf(block)->pages * PAGE_BYTES;
+      flushInUse(mgr);
+    }
+    return block;
+  }
   if (!mgr) {
-    // fprintf(stderr, "Thread-local memory manager is NULL!\n");
-    exit(1);
-  } 
-  // get a chunk
+    return NULL;
+  }
+  // get a chunk, refilling the class if it has run dry
+  int c = myMallocSizeClass[(size + 15) >> 4];
   chunk *toAlloc = NULL;
-  if (size <= 64) {
-      if (!isEmptyList(mgr->freeSmall)) {
-          toAlloc = getChunk(mgr->freeSmall, mgr->allocSmall);
-      } else {
-          pthread_mutex_lock(&overflowLockSmall);
-          if (!isEmptyList(overflowManager->freeSmall)) {
-              toAlloc = getChunk(overflowManager->freeSmall, overflowManager->allocSmall);
-              static int overflowTouched = 0;
-              if (!overflowTouched) {
-                  system("touch Overflow");
-                  overflowTouched = 1;
-              }
-          }
-          pthread_mutex_unlock(&overflowLockSmall);
-      }
+  if (globalMode == 3) {
+      toAlloc = cpuChunk(mgr, c);
+  } else if (!isEmptyList(mgr->cache.freeList[c]) || refill(mgr, c)) {
+      toAlloc = getChunk(mgr->cache.freeList[c]);
+      mgr->cache.freeCount[c]--;
+  } else if ((toAlloc = overflowChunk(c)) != NULL) {
+      mgr->stats.classes[c].overflowHits++;
+  }
+  if (toAlloc) {
+    mgr->cache.allocs[c]++;
+    mgr->cache.requested[c] += size;
+  }
+#ifdef MYMALLOC_DEBUG
+  if (toAlloc) {
+    markLive(toAlloc);
+  }
+#endif
+  return toAlloc;
+}
+
+// push the blocks from first to last, of class c, on owner's remote-free queue. If
+// owner's thread has exited, nothing will drain the queue until another thread takes the
+// heap, so the freeing thread moves it to the overflow pool itself
+static void remoteFreeList(memManager *owner, int c, chunk *first, chunk *last) {
+  chunk stranded;
+  remotePushList(&owner->remoteFree[c], first, last);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&owner->exited, __ATOMIC_RELAXED)) {
+    stranded.next = remoteTakeAll(&owner->remoteFree[c]);
+    overflowReturnList(c, &stranded);
+  }
+}
+
+// myFree just needs to put the block back on its class's free list; the page map gives
+// the slab the pointer is in, and with it the class and the manager that owns the slab.
+// A block of another thread's heap goes on that heap's remote-free queue, never on the
+// freeing thread's lists. This is the slow path of the inline myFree in myMalloc.h
+void myFreeSlow(void *ptr) {
+  if (!ptr) {
+    return;
+  }
+  span *s = spanOf(ptr);
+  // a free span still has its ends in the page map, for coalescing
+  if (!s || s->kind == SPAN_FREE) {
+    fprintf(stderr, "myFree: %p was not allocated by myMalloc\n", ptr);
+    return;
+  }
+  if (s->kind == SPAN_POOL || s->kind == SPAN_ARENA) {
+    fprintf(stderr, "myFree: %p belongs to a%s\n", ptr, (s->kind == SPAN_POOL) ? " pool; use myPoolFree" : "n arena; use myArenaReset");
+    return;
+  }
+  memManager *mgr = assignThreadManager();
+  if (s->kind == SPAN_BUDDY) {
+    int order = buddyFree(s, ptr);
+    if (order < 0) {
+      fprintf(stderr, "myFree: %p is not an allocated block\n", ptr);
+    } else if (mgr) {
+      mgr->cache.frees[BUDDY_CLASS + order]++;
+      flushInUse(mgr);
+    }
+    return;
+  }
+  if (s->kind != SPAN_SLAB) {
+    if (mgr) {
+      mgr->cache.frees[LARGE_CLASS]++;
+      mgr->stats.largeBytes -= s->pages * PAGE_BYTES;
+      flushInUse(mgr);
+    }
+    largeFree(s);
+    return;
+  }
+  int c = s->sizeClass;
+#ifdef MYMALLOC_DEBUG
+  if (!markFree(s, ptr)) {
+    return;
+  }
+#endif
+
+  // Determine if this pointer is from overflow, this thread's heap or another's; overflow
+  // blocks are cached like the thread's own, except by coarse mode heaps, and go to the
+  // CPU's cache in per-CPU mode (where every block is from overflow)
+  memManager *owner = (memManager *) s->owner;
+  if (mgr) {
+    mgr->cache.frees[c]++;
+    if (owner != mgr && owner != overflowManager) mgr->stats.classes[c].remoteFrees++;
+  }
+  if (owner == mgr || (owner == overflowManager && mgr && mgr->limit >= 0)) {
+    returnChunk(mgr->cache.freeList[c], (chunk *) ptr);
+    mgr->cache.freeCount[c]++;
+    releaseSurplus(mgr, c);
+  } else if (owner == overflowManager && globalMode == 3) {
+    cpuReturn(c, (chunk *) ptr);
+  } else if (owner == overflowManager) {
+    overflowReturn(c, (chunk *) ptr);
+  } else {
+    remoteFreeList(owner, c, (chunk *) ptr, (chunk *) ptr);
+  }
+}
+
+// batch routines; debug builds take every block of a batch through myMallocSlow and
+// myFreeSlow, so that each one is tracked, and do without these
+#ifndef MYMALLOC_DEBUG
+
+// allocate count blocks of class c for mgr into out; returns how many it got. Thread
+// heaps make up what their cache lacks with at most one take from the remote-free queue
+// and one from the overflow pool, then slabs; heaps that keep no blocks take from the
+// CPU's cache in per-CPU mode, then one batch from the overflow pool and hand back any
+// surplus. Whatever is still missing comes a block at a time
+static int mallocRun(memManager *mgr, int c, int size, int count, void **out) {
+  chunk *list = mgr->cache.freeList[c], taken;
+  int got = 0, n;
+
+  if (mgr->limit >= 0) {
+    if (mgr->cache.freeCount[c] < count) drainRemote(mgr, c);
+    if (mgr->cache.freeCount[c] < count) {
+      n = overflowTake(c, list, count - mgr->cache.freeCount[c]);
+      mgr->cache.freeCount[c] += n;
+      mgr->stats.classes[c].overflowHits += n;
+    }
+    while (mgr->cache.freeCount[c] < count && newSlab(mgr, c));
+    got = takeChunks(list, out, count);
+    mgr->cache.freeCount[c] -= got;
   } else {
-      if (!isEmptyList(mgr->freeLarge)) {
-          toAlloc = getChunk(mgr->freeLarge, mgr->allocLarge);
+    if (globalMode == 3) {
+      while (got < count && (out[got] = percpuPop(c)) != NULL) got++;
+    }
+    if (got < count) {
+      taken.next = NULL;
+      mgr->stats.classes[c].overflowHits += overflowTake(c, &taken, count - got);
+      got += takeChunks(&taken, out + got, count - got);
+      overflowReturnList(c, &taken);
+    }
+  }
+  while (got < count && (out[got] = overflowChunk(c)) != NULL) {
+    mgr->stats.classes[c].overflowHits++;
+    got++;
+  }
+  mgr->cache.allocs[c] += got;
+  mgr->cache.requested[c] += (long) got * size;
+  return got;
+}
+
+// free the n blocks of items, all of class c from slabs of owner, as one run: spliced
+// onto mgr's cache, pushed on owner's remote-free queue or returned to the overflow pool
+// in one step, or put in the CPU's cache in per-CPU mode as far as it has room
+static void freeRun(memManager *mgr, memManager *owner, int c, void **items, int n) {
+  chunk run;
+
+  if (mgr) {
+    mgr->cache.frees[c] += n;
+    if (owner != mgr && owner != overflowManager) mgr->stats.classes[c].remoteFrees += n;
+  }
+  if (owner == mgr || (owner == overflowManager && mgr && mgr->limit >= 0)) {
+    returnChunks(mgr->cache.freeList[c], items, n);
+    mgr->cache.freeCount[c] += n;
+    releaseSurplus(mgr, c);
+    return;
+  }
+  if (owner == overflowManager && globalMode == 3) {
+    while (n > 0 && percpuPush(c, items[0])) {
+      items++;
+      n--;
+    }
+    if (n == 0) return;
+  }
+  run.next = NULL;
+  returnChunks(&run, items, n);
+  if (owner == overflowManager) {
+    overflowReturnList(c, &run);
+  } else {
+    remoteFreeList(owner, c, run.next, (chunk *) items[n - 1]);
+  }
+}
+
+#endif
+
+int myMallocBatch(int size, int count, void **out) {
+  int got = 0;
+
+  if (size < 0 || count <= 0) {
+    return 0;
+  }
+#ifndef MYMALLOC_DEBUG
+  memManager *mgr = assignThreadManager();
+  if (mgr && size <= MAX_SMALL) {
+    got = mallocRun(mgr, myMallocSizeClass[(size + 15) >> 4], size, count, out);
+    flushInUse(mgr);
+    return got;
+  }
+#endif
+  // larger blocks come from the buddy tier or page heap one at a time anyway, and debug builds track
+  // every block
+  while (got < count && (out[got] = myMallocSlow(size)) != NULL) {
+    got++;
+  }
+  return got;
+}
+
+void myFreeBatch(void **ptrs, int count) {
+  int i = 0;
+
+#ifndef MYMALLOC_DEBUG
+  memManager *mgr = assignThreadManager();
+  span *s, *t;
+  int j;
+  while (i < count) {
+    if (!ptrs[i] || (s = spanOf(ptrs[i])) == NULL || s->kind != SPAN_SLAB) {
+      // NULL, large or foreign pointers take the usual path
+      myFreeSlow(ptrs[i++]);
+      continue;
+    }
+    // the run of blocks with the same class and owner as this one
+    for (j = i + 1; j < count && ptrs[j]; j++) {
+      t = spanOf(ptrs[j]);
+      if (!t || t->kind != SPAN_SLAB || t->owner != s->owner || t->sizeClass != s->sizeClass) break;
+    }
+    freeRun(mgr, (memManager *) s->owner, s->sizeClass, ptrs + i, j - i);
+    i = j;
+  }
+#endif
+  for (; i < count; i++) {
+    myFreeSlow(ptrs[i]);
+  }
+}
+
+// the inline myFree has pushed this thread's cache of class c past its high-water mark
+void myFreeSurplus(int sizeClass) {
+  releaseSurplus(threadHeap, sizeClass);
+}
+
+// statistics
+
+// add the counters of heap mgr, or of every heap if mgr is NULL, into stats
+static void gatherStats(memManager *mgr, myMallocStatistics *stats) {
+  memManager *heap;
+  int c;
+
+  memset(stats, 0, sizeof(myMallocStatistics));
+  pthread_mutex_lock(&idAssignLock);
+  stats->threadHeaps = heapCount;
+  for (heap = allHeaps; heap; heap = heap->nextAll) {
+    if (mgr && heap != mgr) continue;
+    for (c = 0; c < STATS_CLASSES; c++) {
+      classCounters *from = &heap->stats.classes[c];
+      myMallocClassStats *to = &stats->classes[c];
+      to->allocs += heap->cache.allocs[c];
+      to->frees += heap->cache.frees[c];
+      to->overflowHits += from->overflowHits;
+      to->remoteFrees += from->remoteFrees;
+      to->requestedBytes += heap->cache.requested[c];
+      if (c < LARGE_CLASS) {
+        to->bytesInUse += (heap->cache.allocs[c] - heap->cache.frees[c]) * statBlockSize(c);
       } else {
-          pthread_mutex_lock(&overflowLockLarge);
-          if (!isEmptyList(overflowManager->freeLarge)) {
-              toAlloc = getChunk(overflowManager->freeLarge, overflowManager->allocLarge);
-              static int overflowTouched = 0;
-              if (!overflowTouched) {
-                  system("touch Overflow");
-                  overflowTouched = 1;
-              }
-          }
-          pthread_mutex_unlock(&overflowLockLarge);
+        to->bytesInUse += heap->stats.largeBytes;
       }
+    }
+  }
+  pthread_mutex_unlock(&idAssignLock);
+
+  stats->heapBytes = buddyRegionBytes();
+  for (c = 0; c < STATS_CLASSES; c++) {
+    myMallocClassStats *cs = &stats->classes[c];
+    cs->blockSize = (int) statBlockSize(c);
+    if (c < NUM_CLASSES) {
+      cs->slabBytes = __atomic_load_n(&classSlabBytes[c], __ATOMIC_RELAXED);
+      stats->heapBytes += cs->slabBytes;
+    } else if (c == LARGE_CLASS) {
+      // large blocks are whole pages of their own
+      stats->heapBytes += cs->bytesInUse;
+    }
+    if (cs->slabBytes > 0) {
+      cs->fragmentation = 1.0 - (double) cs->bytesInUse / cs->slabBytes;
+    }
+    // internal fragmentation over every allocation so far; blocks above 16 KB are not
+    // counted by size, so theirs is not known
+    if (cs->blockSize > 0 && cs->allocs > 0) {
+      cs->internalFragmentation = 1.0 - (double) cs->requestedBytes / ((double) cs->allocs * cs->blockSize);
+    }
+    stats->allocs += cs->allocs;
+    stats->frees += cs->frees;
+    stats->overflowHits += cs->overflowHits;
+    stats->remoteFrees += cs->remoteFrees;
+    stats->bytesInUse += cs->bytesInUse;
+  }
+  stats->peakBytesInUse = __atomic_load_n(&peakBytesInUse, __ATOMIC_RELAXED);
+  if (stats->peakBytesInUse < stats->bytesInUse) {
+    stats->peakBytesInUse = stats->bytesInUse;
+  }
+  if (!mgr && stats->heapBytes > 0) {
+    stats->fragmentation = 1.0 - (double) stats->bytesInUse / stats->heapBytes;
+  }
+  if (mgr) {
+    // one heap's share of the shared totals is not known
+    stats->heapBytes = stats->peakBytesInUse = 0;
   }
-  return toAlloc ? (void *)((char *)toAlloc + sizeof(chunk)) : NULL;
 }
 
-// myFree just needs to put the block back on the free list
-// note that this involves taking the pointer that is passed in by the user and
-// getting the pointer to the beginning of the chunk (so moving backwards chunk bytes)
-void myFree(void *ptr) {
-  if (!ptr) {
-    return;
+void myMallocStats(myMallocStatistics *stats) {
+  gatherStats(NULL, stats);
+}
+
+int myMallocThreadStats(int heap, myMallocStatistics *stats) {
+  memManager *mgr;
+
+  if (heap < 0) {
+    mgr = threadHeap;
+  } else {
+    pthread_mutex_lock(&idAssignLock);
+    for (mgr = allHeaps; mgr && mgr->id != heap; mgr = mgr->nextAll);
+    pthread_mutex_unlock(&idAssignLock);
   }
-  // find the front of the chunk
-  chunk *toFree = (chunk *) ((char *) ptr - sizeof(chunk));
-  assignThreadManager();
-  memManager *mgr = (memManager *) pthread_getspecific(threadKey);
   if (!mgr) {
-    fprintf(stderr, "Thread-local memory manager is NULL!\n");
-    exit(1);
-  } 
-
-  // Determine if this pointer is from overflow
-  if (toFree >= (chunk *)overflowManager->startLargeMem && toFree < (chunk *)overflowManager->endLargeMem) {
-    if (toFree->allocSize <= 64) {
-        pthread_mutex_lock(&overflowLockSmall);
-        returnChunk(overflowManager->freeSmall, overflowManager->allocSmall, toFree);
-        pthread_mutex_unlock(&overflowLockSmall);
+    return -1;
+  }
+  gatherStats(mgr, stats);
+  return 0;
+}
+
+// append a report of the current statistics to path
+static int writeStats(const char *path) {
+  myMallocStatistics stats;
+  FILE *fp = fopen(path, "a");
+  int c;
+
+  if (!fp) {
+    return -1;
+  }
+  myMallocStats(&stats);
+  fprintf(fp, "heaps %d allocs %ld frees %ld overflowHits %ld remoteFrees %ld\n", stats.threadHeaps,
+          stats.allocs, stats.frees, stats.overflowHits, stats.remoteFrees);
+  fprintf(fp, "inUse %ld peak %ld heap %ld fragmentation %.3f\n", stats.bytesInUse,
+          stats.peakBytesInUse, stats.heapBytes, stats.fragmentation);
+  for (c = 0; c < STATS_CLASSES; c++) {
+    myMallocClassStats *cs = &stats.classes[c];
+    if (cs->allocs == 0 && cs->frees == 0) continue;
+    if (c < NUM_CLASSES) {
+      fprintf(fp, "  class %5d:", cs->blockSize);
+    } else if (c < LARGE_CLASS) {
+      fprintf(fp, "  buddy %5d:", cs->blockSize);
     } else {
-        pthread_mutex_lock(&overflowLockLarge);
-        returnChunk(overflowManager->freeLarge, overflowManager->allocLarge, toFree);
-        pthread_mutex_unlock(&overflowLockLarge);
+      fprintf(fp, "  large      :");
     }
-  } else {
-    if (toFree->allocSize <= 64) {
-        returnChunk(mgr->freeSmall, mgr->allocSmall, toFree);
-    } else {
-        returnChunk(mgr->freeLarge, mgr->allocLarge, toFree);
+    fprintf(fp, " allocs %ld frees %ld overflowHits %ld remoteFrees %ld inUse %ld slabs %ld fragmentation %.3f internal %.3f\n",
+            cs->allocs, cs->frees, cs->overflowHits, cs->remoteFrees, cs->bytesInUse,
+            cs->slabBytes, cs->fragmentation, cs->internalFragmentation);
+  }
+  fclose(fp);
+  return 0;
+}
+
+// periodic dumps: one background thread, told where and how often by the last call. It
+// waits on dumpChanged, so a new setting restarts its interval and a stop wakes it to
+// exit; dumpControlLock keeps calls from starting a thread while another is stopping one
+static char dumpPath[256];
+static int dumpSeconds;
+static long dumpChanges = 0;   // calls so far, so the thread can tell a change from a timeout
+static int dumpRunning = 0;
+static pthread_t dumpThreadId;
+static pthread_mutex_t dumpLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t dumpControlLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t dumpChanged = PTHREAD_COND_INITIALIZER;
+
+static void *dumpThread(void *arg) {
+  char path[256];
+  struct timespec deadline;
+  long changes;
+  int rc;
+
+  pthread_mutex_lock(&dumpLock);
+  while (dumpSeconds > 0) {
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += dumpSeconds;
+    changes = dumpChanges;
+    rc = 0;
+    while (dumpChanges == changes && rc != ETIMEDOUT) {
+      rc = pthread_cond_timedwait(&dumpChanged, &dumpLock, &deadline);
+    }
+    if (dumpChanges != changes) {
+      continue;
     }
+    snprintf(path, sizeof(path), "%s", dumpPath);
+    pthread_mutex_unlock(&dumpLock);
+    writeStats(path);
+    pthread_mutex_lock(&dumpLock);
+  }
+  pthread_mutex_unlock(&dumpLock);
+  return NULL;
+}
+
+int myMallocStatsDump(const char *path, int seconds) {
+  int rc = writeStats(path), stop = 0;
+
+  pthread_mutex_lock(&dumpControlLock);
+  pthread_mutex_lock(&dumpLock);
+  snprintf(dumpPath, sizeof(dumpPath), "%s", path);
+  dumpSeconds = seconds;
+  dumpChanges++;
+  pthread_cond_signal(&dumpChanged);
+  if (seconds > 0 && !dumpRunning) {
+    dumpRunning = (pthread_create(&dumpThreadId, NULL, dumpThread, NULL) == 0);
+  } else if (seconds <= 0 && dumpRunning) {
+    dumpRunning = 0;
+    stop = 1;
+  }
+  pthread_mutex_unlock(&dumpLock);
+  // the thread has seen the stop once it has exited, so no report follows this call
+  if (stop) {
+    pthread_join(dumpThreadId, NULL);
   }
+  pthread_mutex_unlock(&dumpControlLock);
+  return rc;
+}
+
+// out-of-line myMalloc and myFree, for callers that declare them without myMalloc.h
+#undef myMalloc
+#undef myFree
+
+void *myMalloc(int size) {
+  return myMallocInline(size);
+}
+
+void myFree(void *ptr) {
+  myFreeInline(ptr);
 }
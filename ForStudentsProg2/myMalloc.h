@@ -1,6 +1,160 @@
 // CSc 422
 // Program 2 header file for myMalloc
 
+#ifndef MYMALLOC_H
+#define MYMALLOC_H
+
+#include "myMalloc-helper.h"
+#include "myMalloc-pages.h"
+#include "myMalloc-pool.h"
+#include "myMalloc-arena.h"
+
+// flag: 0 sequential, 1 coarse-grain (every thread shares one pool), 2 fine-grain (a
+// heap per thread) or 3 per-CPU (a cache per CPU in front of the shared pool, so memory
+// grows with cores rather than threads; see myMalloc-percpu.h)
 int myInit(int numThreads, int flag);
+
+// sizes for myInitWithConfig; myInit uses 8 KB slabs and no limits. Thread heaps (and the
+// shared overflow pool) grow one slab at a time from the page heap as size classes run
+// dry; a thread heap at its limit falls back to the overflow pool, and myMalloc returns
+// NULL once that is at its limit too. slabSize must be a multiple of the 4 KB page size
+typedef struct myMallocConfig {
+  int slabSize;          // bytes per slab
+  long threadHeapLimit;  // bytes of slabs per thread heap, 0 for no limit
+  long overflowLimit;    // bytes of slabs in the overflow pool, 0 for no limit
+  int lockedOverflow;    // 1 to keep the overflow pool behind per-class mutexes, 0 (the
+                         // default) for lock-free stacks
+} myMallocConfig;
+
+// 0 on success, -1 if the configuration is invalid or memory runs out
+int myInitWithConfig(int numThreads, int flag, const myMallocConfig *config);
 void *myMalloc(int size);
 void myFree(void *ptr);
+
+// batches for callers that allocate and free blocks in groups: myMallocBatch puts count
+// blocks of size bytes in out and returns how many it could get (fewer only if memory
+// runs out); myFreeBatch frees count blocks, NULL ones skipped. Each moves a run of
+// blocks of one class and owner in one splice, and takes the overflow pool or a
+// remote-free queue once per run rather than once per block. Debug builds move every
+// block singly, through the checks of myMalloc and myFree
+int myMallocBatch(int size, int count, void **out);
+void myFreeBatch(void **ptrs, int count);
+
+// blocks currently allocated, in builds with -DMYMALLOC_DEBUG (see driverDebug in the
+// Makefile); -1 otherwise, since normal builds do not track allocated blocks
+long myMallocLiveBlocks();
+
+// overflow pool operations (pops and pushes) and contention (failed compare-and-swaps, or
+// lock attempts that found the lock held) since myInit; coarse mode (flag 1) takes every
+// small block through the overflow pool
+void myMallocOverflowContention(long *ops, long *retries);
+
+// allocator statistics, from counters each thread heap keeps in cache lines of its own
+// and adds up only when asked; they are approximate while other threads are running.
+// Classes are the 20 size classes in order, then the 4 orders of the buddy tier (blocks of
+// 2 to 16 KB, for requests of 1025 bytes to 16 KB), then blocks above 16 KB
+#define MYMALLOC_CLASSES 20
+#define MYMALLOC_BUDDY_ORDERS 4
+#define MYMALLOC_STAT_CLASSES (MYMALLOC_CLASSES + MYMALLOC_BUDDY_ORDERS + 1)
+
+typedef struct myMallocClassStats {
+  int blockSize;          // 0 for blocks above 16 KB
+  long allocs;
+  long frees;
+  long overflowHits;      // blocks taken from the shared overflow pool
+  long remoteFrees;       // frees of blocks that another thread's heap owns
+  long bytesInUse;        // by block size, or whole pages above 16 KB
+  long slabBytes;         // slab bytes carved for the class (0 for the buddy orders, which share regions)
+  double fragmentation;   // share of slabBytes not in use
+  long requestedBytes;    // bytes the class's allocations asked for
+  double internalFragmentation;  // share of the bytes handed out that they did not ask for
+} myMallocClassStats;
+
+typedef struct myMallocStatistics {
+  int threadHeaps;        // heaps created since myInit
+  long allocs;
+  long frees;
+  long overflowHits;
+  long remoteFrees;
+  long bytesInUse;
+  long peakBytesInUse;
+  long heapBytes;         // slab bytes, buddy regions and large blocks in use
+  double fragmentation;   // share of heapBytes not in use
+  myMallocClassStats classes[MYMALLOC_STAT_CLASSES];
+} myMallocStatistics;
+
+// totals over every thread since myInit
+void myMallocStats(myMallocStatistics *stats);
+
+// the mallocs and frees made through one heap, numbered from 0 in the order threads
+// first used myMalloc (-1 for the calling thread's); bytes in use can be negative for a
+// thread that frees what others allocated, and peak and heap bytes are only kept in
+// total. -1 if there is no such heap
+int myMallocThreadStats(int heap, myMallocStatistics *stats);
+
+// append a report of myMallocStats to path now and, if seconds > 0, every seconds from
+// a background thread (later calls change the path and restart the interval, and 0 stops
+// it: the call returns once the thread has exited, so no report follows it)
+int myMallocStatsDump(const char *path, int seconds);
+
+// fast paths: through this header myMalloc and myFree are the inline functions below,
+// which pop and push a block on the calling thread's cache, and call into myMalloc.c for
+// everything else (an empty class, a full one, blocks above 1024 bytes or of another
+// heap, a thread without a heap yet, and every call in coarse mode or in -DMYMALLOC_DEBUG
+// builds of myMalloc.c). The cache is the part of a thread heap these need, and is found
+// through an initial-exec TLS variable
+#define MYMALLOC_MAX_SMALL 1024
+
+typedef struct myMallocCache {
+  chunk *freeList[MYMALLOC_CLASSES];   // dummy headers
+  int freeCount[MYMALLOC_CLASSES];
+  int highWater[MYMALLOC_CLASSES];     // past this many free blocks myFree gives some back
+  long allocs[MYMALLOC_STAT_CLASSES];  // per statistics class
+  long frees[MYMALLOC_STAT_CLASSES];
+  long requested[MYMALLOC_STAT_CLASSES];  // bytes the allocations asked for
+} myMallocCache;
+
+extern __thread myMallocCache *myMallocThreadCache __attribute__((tls_model("initial-exec")));
+extern unsigned char myMallocSizeClass[MYMALLOC_MAX_SMALL / 16 + 1];
+
+void *myMallocSlow(int size);
+void myFreeSlow(void *ptr);
+void myFreeSurplus(int sizeClass);
+
+static inline void *myMallocInline(int size) {
+  myMallocCache *cache = myMallocThreadCache;
+  if (cache && (unsigned) size <= MYMALLOC_MAX_SMALL) {
+    int c = myMallocSizeClass[(size + 15) >> 4];
+    chunk *block = cache->freeList[c]->next;
+    if (block) {
+      cache->freeList[c]->next = block->next;
+      cache->freeCount[c]--;
+      cache->allocs[c]++;
+      cache->requested[c] += size;
+      return block;
+    }
+  }
+  return myMallocSlow(size);
+}
+
+static inline void myFreeInline(void *ptr) {
+  myMallocCache *cache = myMallocThreadCache;
+  span *s;
+  // only slabs have an owner, so this is a block of one of this thread's slabs
+  if (cache && ptr && (s = spanOf(ptr)) != NULL && s->owner == (void *) cache) {
+    int c = s->sizeClass;
+    ((chunk *) ptr)->next = cache->freeList[c]->next;
+    cache->freeList[c]->next = (chunk *) ptr;
+    cache->frees[c]++;
+    if (++cache->freeCount[c] > cache->highWater[c]) {
+      myFreeSurplus(c);
+    }
+    return;
+  }
+  myFreeSlow(ptr);
+}
+
+#define myMalloc(size) myMallocInline(size)
+#define myFree(ptr) myFreeInline(ptr)
+
+#endif
@@ -0,0 +1,251 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+
+// columnsort benchmark: sweeps n, thread counts, r/s shapes and input distributions
+// by running the seqsort and parsort drivers, and reports throughput, speedup and
+// efficiency versus seqsort with 95% confidence intervals over repeated runs. -engines=
+// also runs parsort's sample sort and merge sort engines; they ignore the shape, so they
+// run once per n at the first shape, and are reported with the engine name as impl
+//
+// usage: bench [-n=N,N,...] [-threads=T,T,...] [-dist=D,D,...] [-shapes=K] [-reps=R]
+//              [-engines=E,E,...] [-format=csv|json] [-out=FILE] [-seq=PATH] [-par=PATH]
+
+#define MAX_LIST 32
+#define MAX_REPS 100
+
+// two-sided 95% t quantiles for 1..30 degrees of freedom
+static const double tTable[30] = {
+  12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+  2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+  2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042
+};
+
+typedef struct runStats {
+  double mean;
+  double stddev;
+  double ci95;   // half-width of the 95% confidence interval of the mean
+  int ok;        // every run printed "correct"
+} runStats;
+
+static const char *seqPath = "./seqsort";
+static const char *parPath = "./parsort";
+static FILE *out;
+static int json = 0;
+static int firstRecord = 1;
+
+// parse a comma-separated list of longs, returning how many were read
+static int parseList(const char *arg, long *vals) {
+  int count = 0;
+  char *end;
+  while (*arg && count < MAX_LIST) {
+    vals[count++] = strtol(arg, &end, 10);
+    if (*end != ',') {
+      break;
+    }
+    arg = end + 1;
+  }
+  return count;
+}
+
+static int splitNames(char *arg, char **names) {
+  int count = 0;
+  char *tok = strtok(arg, ",");
+  while (tok && count < MAX_LIST) {
+    names[count++] = tok;
+    tok = strtok(NULL, ",");
+  }
+  return count;
+}
+
+// the valid shapes for n with the most columns first: s | n, s | r and r >= 2(s-1)^2
+static int validShapes(long n, long *shapes, int maxShapes) {
+  long s;
+  int count = 0;
+  for (s = (long) sqrt((double) n); s >= 1 && count < maxShapes; s--) {
+    long r = n / s;
+    if (n % s == 0 && r % s == 0 && r >= 2 * (s - 1) * (s - 1)) {
+      shapes[count++] = s;
+    }
+  }
+  return count;
+}
+
+// run one driver reps times and summarise the elapsed times it reports; failed runs are
+// left out of the mean and spread, and leave them 0 if no run succeeded
+static runStats runDriver(const char *path, long n, long threads, long s, const char *dist,
+                          const char *engine, int reps) {
+  char cmd[1024], line[256];
+  double times[MAX_REPS], sum = 0.0, sq = 0.0;
+  int rep, got, good = 0;
+  runStats rs = {0.0, 0.0, 0.0, 1};
+
+  snprintf(cmd, sizeof(cmd), "%s %ld %ld -dist=%s -s=%ld -engine=%s -precise -verify=hash",
+           path, n, threads, dist, s, engine);
+  for (rep = 0; rep < reps; rep++) {
+    FILE *fp = popen(cmd, "r");
+    int correct = 0;
+    got = 0;
+    if (!fp) {
+      perror("popen");
+      exit(1);
+    }
+    while (fgets(line, sizeof(line), fp)) {
+      if (strncmp(line, "correct", 7) == 0) {
+        correct = 1;
+      } else if (sscanf(line, "elapsedTime is %lf", &times[good]) == 1) {
+        got = 1;
+      }
+    }
+    if (pclose(fp) != 0 || !correct || !got) {
+      fprintf(stderr, "run failed: %s\n", cmd);
+      rs.ok = 0;
+      continue;
+    }
+    sum += times[good++];
+  }
+
+  if (good == 0) {
+    return rs;
+  }
+  rs.mean = sum / good;
+  for (rep = 0; rep < good; rep++) {
+    sq += (times[rep] - rs.mean) * (times[rep] - rs.mean);
+  }
+  if (good > 1) {
+    rs.stddev = sqrt(sq / (good - 1));
+    rs.ci95 = ((good - 1 <= 30) ? tTable[good - 2] : 1.96) * rs.stddev / sqrt((double) good);
+  }
+  return rs;
+}
+
+static void report(const char *impl, long n, long s, const char *dist, long threads, int reps,
+                   runStats *rs, runStats *seq) {
+  double keysPerSec = (rs->mean > 0.0) ? n / rs->mean : 0.0;
+  double speedup = (rs->mean > 0.0) ? seq->mean / rs->mean : 0.0;
+  double efficiency = speedup / threads;
+
+  if (json) {
+    fprintf(out, "%s\n  {\"impl\": \"%s\", \"n\": %ld, \"r\": %ld, \"s\": %ld, \"dist\": \"%s\", "
+            "\"threads\": %ld, \"reps\": %d, \"ok\": %d, \"mean\": %.9f, \"stddev\": %.9f, \"ci95\": %.9f, "
+            "\"keysPerSec\": %.1f, \"speedup\": %.4f, \"efficiency\": %.4f}",
+            firstRecord ? "" : ",", impl, n, n / s, s, dist, threads, reps, rs->ok,
+            rs->mean, rs->stddev, rs->ci95, keysPerSec, speedup, efficiency);
+  } else {
+    fprintf(out, "%s,%ld,%ld,%ld,%s,%ld,%d,%d,%.9f,%.9f,%.9f,%.1f,%.4f,%.4f\n",
+            impl, n, n / s, s, dist, threads, reps, rs->ok,
+            rs->mean, rs->stddev, rs->ci95, keysPerSec, speedup, efficiency);
+  }
+  fflush(out);
+  firstRecord = 0;
+
+  fprintf(stderr, "%-10s n=%-10ld s=%-5ld %-9s t=%-3ld %.4fs +- %.4f  %.3g keys/s  speedup %.2f  eff %.2f%s\n",
+          impl, n, s, dist, threads, rs->mean, rs->ci95, keysPerSec, speedup, efficiency,
+          rs->ok ? "" : "  FAILED");
+}
+
+int main(int argc, char *argv[]) {
+  long nList[MAX_LIST] = {262144, 1048576, 4194304};
+  long threadList[MAX_LIST];
+  char distArg[256] = "uniform,few,zipf,sorted,reverse,sawtooth";
+  char *dists[MAX_LIST];
+  char engineArg[256] = "columnsort";
+  char *engines[MAX_LIST];
+  long shapes[MAX_LIST];
+  int numN = 3, numThreads = 0, numDists, numEngines, numShapes, maxShapes = 3, reps = 5;
+  int i, a, b, c, d, e, failed = 0;
+  long cores = sysconf(_SC_NPROCESSORS_ONLN);
+
+  out = stdout;
+  // default thread sweep: powers of two up to the core count, plus the core count itself
+  for (i = 1; i < cores && numThreads < MAX_LIST - 1; i *= 2) {
+    threadList[numThreads++] = i;
+  }
+  threadList[numThreads++] = cores;
+
+  for (i = 1; i < argc; i++) {
+    if (strncmp(argv[i], "-n=", 3) == 0) {
+      numN = parseList(argv[i] + 3, nList);
+    } else if (strncmp(argv[i], "-threads=", 9) == 0) {
+      numThreads = parseList(argv[i] + 9, threadList);
+    } else if (strncmp(argv[i], "-dist=", 6) == 0) {
+      snprintf(distArg, sizeof(distArg), "%s", argv[i] + 6);
+    } else if (strncmp(argv[i], "-engines=", 9) == 0) {
+      snprintf(engineArg, sizeof(engineArg), "%s", argv[i] + 9);
+    } else if (strncmp(argv[i], "-shapes=", 8) == 0) {
+      maxShapes = atoi(argv[i] + 8);
+    } else if (strncmp(argv[i], "-reps=", 6) == 0) {
+      reps = atoi(argv[i] + 6);
+    } else if (strcmp(argv[i], "-format=json") == 0) {
+      json = 1;
+    } else if (strcmp(argv[i], "-format=csv") == 0) {
+      json = 0;
+    } else if (strncmp(argv[i], "-out=", 5) == 0) {
+      out = fopen(argv[i] + 5, "w");
+      if (!out) {
+        perror(argv[i] + 5);
+        return 1;
+      }
+    } else if (strncmp(argv[i], "-seq=", 5) == 0) {
+      seqPath = argv[i] + 5;
+    } else if (strncmp(argv[i], "-par=", 5) == 0) {
+      parPath = argv[i] + 5;
+    } else {
+      fprintf(stderr, "unknown option %s\n", argv[i]);
+      return 1;
+    }
+  }
+  if (reps < 1 || reps > MAX_REPS || maxShapes < 1 || maxShapes > MAX_LIST) {
+    fprintf(stderr, "reps must be 1..%d and shapes 1..%d\n", MAX_REPS, MAX_LIST);
+    return 1;
+  }
+  numDists = splitNames(distArg, dists);
+  numEngines = splitNames(engineArg, engines);
+
+  if (json) {
+    fprintf(out, "[");
+  } else {
+    fprintf(out, "impl,n,r,s,dist,threads,reps,ok,mean,stddev,ci95,keysPerSec,speedup,efficiency\n");
+  }
+
+  for (a = 0; a < numN; a++) {
+    numShapes = validShapes(nList[a], shapes, maxShapes);
+    if (numShapes == 0) {
+      fprintf(stderr, "no valid columnsort shape for n = %ld, skipping\n", nList[a]);
+      continue;
+    }
+    for (b = 0; b < numShapes; b++) {
+      for (c = 0; c < numDists; c++) {
+        // the sequential build is the baseline for speedup and efficiency
+        runStats seq = runDriver(seqPath, nList[a], 1, shapes[b], dists[c], "columnsort", reps);
+        report("seq", nList[a], shapes[b], dists[c], 1, reps, &seq, &seq);
+        failed |= !seq.ok;
+        for (e = 0; e < numEngines; e++) {
+          // only the engines that run columnsort's steps depend on the shape; the
+          // others sort the same n the same way at every r/s, so one shape does
+          int columnsort = (strcmp(engines[e], "columnsort") == 0);
+          int shaped = columnsort || strcmp(engines[e], "hybrid") == 0;
+          if (!shaped && b > 0) {
+            continue;
+          }
+          for (d = 0; d < numThreads; d++) {
+            runStats par = runDriver(parPath, nList[a], threadList[d], shapes[b], dists[c], engines[e], reps);
+            report(columnsort ? "par" : engines[e], nList[a], shapes[b], dists[c], threadList[d], reps, &par, &seq);
+            failed |= !par.ok;
+          }
+        }
+      }
+    }
+  }
+
+  if (json) {
+    fprintf(out, "\n]\n");
+  }
+  if (out != stdout) {
+    fclose(out);
+  }
+  return failed;
+}
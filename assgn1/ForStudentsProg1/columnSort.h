@@ -5,3 +5,78 @@
 //   third and fourth parameters are r and s, respectively, from the columnsort algorithm
 //   fifth parameter is the address of a double into which this routine must write the elapsed time
 void columnSort(int *A, int numThreads, int length, int width, double *elapsedTime);
+
+#include <stddef.h>
+
+// same as columnSort, but with 64-bit r and s for inputs of 2^31 elements or more
+void columnSort64(int *A, int numThreads, size_t length, size_t width, double *elapsedTime);
+
+
+// optional instrumentation (off by default)
+// when enabled, each columnSort call records, for every step and every thread, the time
+// spent computing and the time spent waiting at the barrier; cache misses and instructions
+// come from perf_event_open and are -1 when the counters are not available
+typedef struct stepStats {
+  double computeTime;
+  double barrierTime;
+  long long cacheMisses;
+  long long instructions;
+} stepStats;
+
+void columnSortEnableStats(int enable);
+// shape of the table recorded by the last columnSort call; steps count from 1
+int columnSortStatsThreads();
+int columnSortStatsSteps();
+const char *columnSortStepName(int step);
+// NULL if thread or step is out of range
+const stepStats *columnSortGetStats(int thread, int step);
+
+// memory for the working matrices of the shared-memory builds (malloc by default), and
+// for the scratch array of the sample sort and merge sort engines
+//   CS_MEM_THP      2 MB-aligned anonymous mmap with MADV_HUGEPAGE (transparent huge pages)
+//   CS_MEM_HUGETLB  MAP_HUGETLB from the hugetlbfs pool, falling back to CS_MEM_THP when
+//                   no pages are reserved (see /proc/sys/vm/nr_hugepages)
+// with populate set the matrices are pre-faulted when allocated, before the timer starts.
+// columnSortHugePages returns the number of 2 MB pages that backed the matrices in the
+// last columnSort call, or -1 for CS_MEM_MALLOC
+#define CS_MEM_MALLOC 0
+#define CS_MEM_THP 1
+#define CS_MEM_HUGETLB 2
+
+void columnSortSetMemory(int mode, int populate);
+long columnSortHugePages();
+
+// sort engines; all of them sort A in place through columnSort/columnSort64, with r * s
+// keys, and the threaded build runs them on the same worker threads and barrier
+//   CS_ENGINE_COLUMNSORT  the eight-step columnsort (default), which needs a valid r x s shape
+//   CS_ENGINE_SAMPLESORT  sample sort: buckets from regularly spaced samples, one per thread
+//   CS_ENGINE_MERGESORT   each thread sorts a run, then merges an equal share of the output
+//   CS_ENGINE_HYBRID      columnsort steps 1-4, with step 3 a merge of the sorted runs step 2
+//                         leaves, then in place of steps 5-8 each thread merges a contiguous
+//                         share of A from the s columns, between splitters found by binary
+//                         search within the bound step 4 leaves
+// the sequential build sorts with qsort for sample sort and merge sort and the MPI build
+// supports columnsort only. columnSortSetEngine returns -1 for an unknown engine and
+// columnSortEngineByName returns -1 for an unknown name
+#define CS_ENGINE_COLUMNSORT 0
+#define CS_ENGINE_SAMPLESORT 1
+#define CS_ENGINE_MERGESORT 2
+#define CS_ENGINE_HYBRID 3
+
+int columnSortSetEngine(int engine);
+int columnSortGetEngine();
+int columnSortEngineByName(const char *name);
+const char *columnSortEngineName(int engine);
+
+// auto-tuning
+// columnSortTune reads the cache sizes and core count from sysfs, runs short calibration
+// sorts, and writes a profile to path (NULL means $COLUMNSORT_PROFILE or ~/.columnsort-profile);
+// returns 0 on success. columnSortChooseShape picks r, s and a thread count for n from that
+// profile (or from sysfs defaults if there is none) and returns -1 if n has no valid shape.
+// columnSortAuto sorts n ints using the chosen shape and thread count
+int columnSortTune(const char *path);
+int columnSortChooseShape(size_t n, size_t *length, size_t *width, int *numThreads);
+void columnSortAuto(int *A, size_t n, double *elapsedTime);
+
+// the valid shape with the most columns (s | n, s | r, r >= 2(s-1)^2); s = 1 always qualifies
+void columnSortDefaultShape(size_t n, size_t *length, size_t *width);
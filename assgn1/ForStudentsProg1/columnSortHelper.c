@@ -0,0 +1,489 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <stdint.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "columnSort.h"
+#include "columnSortHelper.h"
+
+static int statsEnabled = 0;
+static int statsThreads = 0, statsSteps = 0;
+static stepStats *statsTable = NULL;
+static const char **statsNames = NULL;
+
+#define HUGE_PAGE_SIZE (2UL * 1024 * 1024)
+#define SMALL_PAGE_SIZE 4096UL
+
+static int memMode = CS_MEM_MALLOC;
+static int memPopulate = 0;
+static int hugetlbWarned = 0;
+static long hugePagesUsed = -1;
+
+static int engine = CS_ENGINE_COLUMNSORT;
+static const char *engineNames[] = {"columnsort", "samplesort", "mergesort", "hybrid", NULL};
+
+// stored just before the row pointers so freeMatrix knows how the block was allocated
+typedef struct matrixHeader {
+  void *base;      // start of the mapping, or the malloc'd block
+  size_t mapped;   // length of the mapping, 0 for malloc
+} matrixHeader;
+
+double csNow() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+// open one counter for the calling thread on any cpu, user space only
+static int perfOpenOne(unsigned long long config) {
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.config = config;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  return (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+void perfOpen(perfCounters *pc) {
+  pc->cacheMissFd = perfOpenOne(PERF_COUNT_HW_CACHE_MISSES);
+  pc->instructionFd = perfOpenOne(PERF_COUNT_HW_INSTRUCTIONS);
+}
+
+static long long perfReadOne(int fd) {
+  long long value;
+  if (fd < 0 || read(fd, &value, sizeof(value)) != sizeof(value)) {
+    return -1;
+  }
+  return value;
+}
+
+// counters are running totals; callers take differences between two reads
+void perfRead(perfCounters *pc, long long *cacheMisses, long long *instructions) {
+  *cacheMisses = perfReadOne(pc->cacheMissFd);
+  *instructions = perfReadOne(pc->instructionFd);
+}
+
+void perfClose(perfCounters *pc) {
+  if (pc->cacheMissFd >= 0) {
+    close(pc->cacheMissFd);
+  }
+  if (pc->instructionFd >= 0) {
+    close(pc->instructionFd);
+  }
+  pc->cacheMissFd = pc->instructionFd = -1;
+}
+
+void columnSortEnableStats(int enable) {
+  statsEnabled = enable;
+}
+
+int statsOn() {
+  return statsEnabled && statsTable != NULL;
+}
+
+int statsBegin(int threads, int steps, const char **stepNames) {
+  int i;
+
+  free(statsTable);
+  statsTable = NULL;
+  statsThreads = statsSteps = 0;
+  if (!statsEnabled) {
+    return 0;
+  }
+
+  statsTable = (stepStats *) malloc(threads * steps * sizeof(stepStats));
+  if (!statsTable) {
+    return 0;
+  }
+  for (i = 0; i < threads * steps; i++) {
+    statsTable[i].computeTime = 0.0;
+    statsTable[i].barrierTime = 0.0;
+    statsTable[i].cacheMisses = -1;
+    statsTable[i].instructions = -1;
+  }
+  statsThreads = threads;
+  statsSteps = steps;
+  statsNames = stepNames;
+  return 1;
+}
+
+// steps count from 1 to match currentStep; a counter of -1 means "not measured"
+void statsAdd(int id, int step, double compute, double barrier, long long cacheMisses, long long instructions) {
+  stepStats *entry;
+
+  if (!statsOn() || id < 0 || id >= statsThreads || step < 1 || step > statsSteps) {
+    return;
+  }
+  entry = &statsTable[id * statsSteps + step - 1];
+  entry->computeTime += compute;
+  entry->barrierTime += barrier;
+  if (cacheMisses >= 0) {
+    entry->cacheMisses = (entry->cacheMisses < 0) ? cacheMisses : entry->cacheMisses + cacheMisses;
+  }
+  if (instructions >= 0) {
+    entry->instructions = (entry->instructions < 0) ? instructions : entry->instructions + instructions;
+  }
+}
+
+int columnSortStatsThreads() {
+  return statsThreads;
+}
+
+int columnSortStatsSteps() {
+  return statsSteps;
+}
+
+const char *columnSortStepName(int step) {
+  if (!statsNames || step < 1 || step > statsSteps) {
+    return NULL;
+  }
+  return statsNames[step - 1];
+}
+
+const stepStats *columnSortGetStats(int thread, int step) {
+  if (!statsTable || thread < 0 || thread >= statsThreads || step < 1 || step > statsSteps) {
+    return NULL;
+  }
+  return &statsTable[thread * statsSteps + step - 1];
+}
+
+void columnSortSetMemory(int mode, int populate) {
+  memMode = mode;
+  memPopulate = populate;
+}
+
+long columnSortHugePages() {
+  return hugePagesUsed;
+}
+
+void matrixBegin() {
+  hugePagesUsed = (memMode == CS_MEM_MALLOC) ? -1 : 0;
+}
+
+// touch every page now so the faults are not charged to the sort
+static void prefault(char *p, size_t len) {
+  size_t i;
+#ifdef MADV_POPULATE_WRITE
+  if (madvise(p, len, MADV_POPULATE_WRITE) == 0) {
+    return;
+  }
+#endif
+  for (i = 0; i < len; i += SMALL_PAGE_SIZE) {
+    p[i] = 0;
+  }
+}
+
+// huge-page backed block of at least bytes; NULL if mmap fails
+static char *mapHuge(size_t bytes, matrixHeader *hdr) {
+  size_t len = (bytes + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+  char *base, *aligned;
+
+  if (memMode == CS_MEM_HUGETLB) {
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | (memPopulate ? MAP_POPULATE : 0);
+    base = (char *) mmap(NULL, len, PROT_READ | PROT_WRITE, flags, -1, 0);
+    if (base != MAP_FAILED) {
+      hdr->base = base;
+      hdr->mapped = len;
+      return base;
+    }
+    if (!hugetlbWarned) {
+      fprintf(stderr, "no hugetlbfs pages available, using transparent huge pages\n");
+      hugetlbWarned = 1;
+    }
+  }
+
+  // over-map by one huge page and advise only the 2 MB-aligned part; the unadvised
+  // ends keep the aligned range in a VMA of its own, so smaps reports it separately
+  base = (char *) mmap(NULL, len + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (base == MAP_FAILED) {
+    return NULL;
+  }
+  aligned = (char *) (((uintptr_t) base + HUGE_PAGE_SIZE - 1) & ~(uintptr_t) (HUGE_PAGE_SIZE - 1));
+  madvise(aligned, len, MADV_HUGEPAGE);
+  if (memPopulate) {
+    prefault(aligned, len);
+  }
+  hdr->base = base;
+  hdr->mapped = len + HUGE_PAGE_SIZE;
+  return aligned;
+}
+
+// 2 MB pages backing the VMA that contains addr, from AnonHugePages and the hugetlb fields
+static long countHugePages(void *addr) {
+  char line[256];
+  unsigned long start, end, kb;
+  unsigned long target = (unsigned long) (uintptr_t) addr;
+  long total = 0;
+  int inside = 0;
+  FILE *fp = fopen("/proc/self/smaps", "r");
+
+  if (!fp) {
+    return -1;
+  }
+  while (fgets(line, sizeof(line), fp)) {
+    if (sscanf(line, "%lx-%lx ", &start, &end) == 2) {
+      if (inside) {
+        break;
+      }
+      inside = (start <= target && target < end);
+    } else if (inside && (sscanf(line, "AnonHugePages: %lu kB", &kb) == 1 ||
+                          sscanf(line, "Private_Hugetlb: %lu kB", &kb) == 1 ||
+                          sscanf(line, "Shared_Hugetlb: %lu kB", &kb) == 1)) {
+      total += kb;
+    }
+  }
+  fclose(fp);
+  return total * 1024 / HUGE_PAGE_SIZE;
+}
+
+int **allocateMatrix(size_t rows, size_t cols) {
+  size_t i, bytes = rows * cols * sizeof(int);
+  int *vals;
+  matrixHeader *hdr;
+  int **temp;
+
+  // allocate the header and vector of pointers
+  hdr = (matrixHeader *) malloc(sizeof(matrixHeader) + rows * sizeof(int *));
+  if (!hdr) {
+    printf("Memory allocation failed for a %zu x %zu matrix\n", rows, cols);
+    exit(1);
+  }
+  // allocate values
+  if (memMode == CS_MEM_MALLOC) {
+    vals = (int *) malloc(bytes);
+    if (vals && memPopulate) {
+      prefault((char *) vals, bytes);
+    }
+    hdr->base = vals;
+    hdr->mapped = 0;
+  } else {
+    vals = (int *) mapHuge(bytes, hdr);
+  }
+  if (!vals) {
+    printf("Memory allocation failed for a %zu x %zu matrix\n", rows, cols);
+    exit(1);
+  }
+  temp = (int **) (hdr + 1);
+  for (i = 0; i < rows; i++) {
+    temp[i] = &(vals[i * cols]);
+  }
+  return temp;
+}
+
+void freeMatrix(int **matrix) {
+  matrixHeader *hdr = ((matrixHeader *) matrix) - 1;
+
+  if (hdr->mapped) {
+    long pages = countHugePages(matrix[0]);
+    if (pages >= 0 && hugePagesUsed >= 0) {
+      hugePagesUsed += pages;
+    }
+    munmap(hdr->base, hdr->mapped);
+  } else {
+    free(hdr->base);
+  }
+  free(hdr);
+}
+
+int columnSortSetEngine(int e) {
+  if (e < 0 || e > CS_ENGINE_HYBRID) {
+    return -1;
+  }
+  engine = e;
+  return 0;
+}
+
+int columnSortGetEngine() {
+  return engine;
+}
+
+int columnSortEngineByName(const char *name) {
+  int e;
+  for (e = 0; engineNames[e]; e++) {
+    if (strcmp(engineNames[e], name) == 0) {
+      return e;
+    }
+  }
+  return -1;
+}
+
+const char *columnSortEngineName(int e) {
+  if (e < 0 || e > CS_ENGINE_HYBRID) {
+    return NULL;
+  }
+  return engineNames[e];
+}
+
+// first position in run[0 .. len) (stride apart) whose key is > v, or >= v if strict
+static size_t runBound(const int *run, size_t len, size_t stride, long long v, int strict) {
+  size_t lo = 0, hi = len;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    long long key = run[mid * stride];
+    if (strict ? key < v : key <= v) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+void multiwaySplit(int **runs, const size_t *lengths, int k, size_t stride, size_t rank, size_t *pos) {
+  multiwaySplitBounded(runs, lengths, k, stride, rank, INT_MIN, INT_MAX, pos);
+}
+
+void multiwaySplitBounded(int **runs, const size_t *lengths, int k, size_t stride, size_t rank,
+                          long long lowKey, long long highKey, size_t *pos) {
+  long long lo = lowKey, hi = highKey;
+  size_t taken = 0, rest;
+  int i;
+
+  // binary search on the key value for v, the key of rank rank in the merged output:
+  // the smallest v with more than rank keys <= v
+  while (lo < hi) {
+    long long mid = (lo + hi) >> 1;
+    size_t count = 0;
+    for (i = 0; i < k && count <= rank; i++) {
+      count += runBound(runs[i], lengths[i], stride, mid, 0);
+    }
+    if (count > rank) {
+      hi = mid;
+    } else {
+      lo = mid + 1;
+    }
+  }
+
+  // every key < v goes below the split, then enough keys == v to make up rank
+  for (i = 0; i < k; i++) {
+    pos[i] = runBound(runs[i], lengths[i], stride, lo, 1);
+    taken += pos[i];
+  }
+  rest = (rank > taken) ? rank - taken : 0;
+  for (i = 0; i < k && rest > 0; i++) {
+    size_t equal = runBound(runs[i], lengths[i], stride, lo, 0) - pos[i];
+    size_t t = (equal < rest) ? equal : rest;
+    pos[i] += t;
+    rest -= t;
+  }
+}
+
+// binary min-heap of run indices keyed on each run's current head
+static void siftDown(int *heap, int size, int **runs, const size_t *next, size_t stride, int at) {
+  for (;;) {
+    int child = 2 * at + 1, top = heap[at];
+    if (child >= size) {
+      return;
+    }
+    if (child + 1 < size &&
+        runs[heap[child + 1]][next[heap[child + 1]] * stride] < runs[heap[child]][next[heap[child]] * stride]) {
+      child++;
+    }
+    if (runs[top][next[top] * stride] <= runs[heap[child]][next[heap[child]] * stride]) {
+      return;
+    }
+    heap[at] = heap[child];
+    heap[child] = top;
+    at = child;
+  }
+}
+
+void hybridMergeRuns(int **matrix, size_t r, size_t s, size_t c, int *out) {
+  size_t seg = r / s;
+  int **runs = (int **) malloc(s * sizeof(int *));
+  int *gathered = (int *) malloc(r * sizeof(int));
+  size_t *start = (size_t *) malloc(2 * s * sizeof(size_t));
+  size_t *end = start + s;
+  size_t a, k;
+
+  if (!runs || !gathered || !start) {
+    printf("Memory allocation failed for the run merge\n");
+    exit(1);
+  }
+  // the matrix is one block, row-major: run a of column c is element a of rows c, c + s, ...;
+  // gather the runs so the merge reads each one sequentially instead of s * s keys apart
+  for (k = 0; k < seg; k++) {
+    const int *row = matrix[c] + k * s * s;
+    for (a = 0; a < s; a++) {
+      gathered[a * seg + k] = row[a];
+    }
+  }
+  for (a = 0; a < s; a++) {
+    runs[a] = gathered + a * seg;
+    start[a] = 0;
+    end[a] = seg;
+  }
+  multiwayMerge(runs, start, end, (int) s, 1, out);
+  free(runs);
+  free(gathered);
+  free(start);
+}
+
+void hybridSplit(int **runs, size_t r, size_t s, size_t rank, size_t *pos) {
+  size_t *lengths = (size_t *) malloc(s * sizeof(size_t));
+  size_t b, p, n = r * s, seg = r / s, bound = (s - 1) * (s - 1);
+  size_t first = (rank > bound) ? rank - bound : 0;
+  size_t last = (rank + bound < n - 1) ? rank + bound : n - 1;
+  long long lowKey = INT_MAX, highKey = INT_MIN;
+
+  if (!lengths) {
+    printf("Memory allocation failed for the split\n");
+    exit(1);
+  }
+  for (b = 0; b < s; b++) {
+    lengths[b] = r;
+  }
+  if (rank >= n) {
+    memcpy(pos, lengths, s * sizeof(size_t));
+    free(lengths);
+    return;
+  }
+  // step 4 moves row j * (r/s) + t of column b to row t * s + b of column j
+  for (p = first; p <= last; p++) {
+    size_t j = p / r, i = p % r;
+    long long key = runs[i % s][j * seg + i / s];
+    if (key < lowKey) lowKey = key;
+    if (key > highKey) highKey = key;
+  }
+  multiwaySplitBounded(runs, lengths, (int) s, 1, rank, lowKey, highKey, pos);
+  free(lengths);
+}
+
+void multiwayMerge(int **runs, const size_t *start, const size_t *end, int k, size_t stride, int *out) {
+  int *heap = (int *) malloc(k * sizeof(int));
+  size_t *next = (size_t *) malloc(k * sizeof(size_t));
+  int i, size = 0;
+
+  if (!heap || !next) {
+    printf("Memory allocation failed for the merge heap\n");
+    exit(1);
+  }
+  for (i = 0; i < k; i++) {
+    next[i] = start[i];
+    if (start[i] < end[i]) {
+      heap[size++] = i;
+    }
+  }
+  for (i = size / 2 - 1; i >= 0; i--) {
+    siftDown(heap, size, runs, next, stride, i);
+  }
+  while (size > 0) {
+    int top = heap[0];
+    *out++ = runs[top][next[top] * stride];
+    if (++next[top] == end[top]) {
+      heap[0] = heap[--size];
+    }
+    siftDown(heap, size, runs, next, stride, 0);
+  }
+  free(heap);
+  free(next);
+}
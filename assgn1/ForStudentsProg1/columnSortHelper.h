@@ -0,0 +1,54 @@
+// helper routines shared by the sequential, threaded and MPI columnsort builds
+
+// wall-clock time in seconds from a monotonic clock
+double csNow();
+
+// hardware counters for one thread; fd is -1 when perf_event_open is not available
+typedef struct perfCounters {
+  int cacheMissFd;
+  int instructionFd;
+} perfCounters;
+
+void perfOpen(perfCounters *pc);
+void perfRead(perfCounters *pc, long long *cacheMisses, long long *instructions);
+void perfClose(perfCounters *pc);
+
+// instrumentation table: one stepStats entry per (thread, step)
+// statsBegin allocates a fresh table if instrumentation is enabled and returns
+// whether it is; statsAdd accumulates into the entry for (id, step)
+int statsBegin(int threads, int steps, const char **stepNames);
+int statsOn();
+void statsAdd(int id, int step, double compute, double barrier, long long cacheMisses, long long instructions);
+
+// working matrices for the shared-memory builds: one rows x cols block of ints plus a
+// vector of row pointers; the block comes from malloc or from a huge-page mmap depending
+// on columnSortSetMemory. freeMatrix records how many huge pages backed the block, and
+// matrixBegin clears that count at the start of a columnSort call
+int **allocateMatrix(size_t rows, size_t cols);
+void freeMatrix(int **matrix);
+void matrixBegin();
+
+// k-way merging of sorted runs; run i holds lengths[i] keys at runs[i][0], runs[i][stride], ...
+// multiwaySplit finds positions pos[i] such that the first rank keys of the merged output are
+// exactly the run prefixes [0, pos[i]); equal keys are taken from lower-numbered runs first, so
+// splitting at increasing ranks gives non-decreasing positions
+void multiwaySplit(int **runs, const size_t *lengths, int k, size_t stride, size_t rank, size_t *pos);
+// merge runs[i][start[i] .. end[i]) into out
+void multiwayMerge(int **runs, const size_t *start, const size_t *end, int k, size_t stride, int *out);
+
+// multiwaySplit with the key of rank rank known to lie in [lowKey, highKey], which narrows
+// the binary search; multiwaySplit itself searches the whole int range
+void multiwaySplitBounded(int **runs, const size_t *lengths, int k, size_t stride, size_t rank,
+                          long long lowKey, long long highKey, size_t *pos);
+
+// the hybrid engine: columnsort steps 1-4, then a multiway merge of the s columns. matrix is
+// the r x s matrix after step 1; runs holds the s columns sorted by step 3, one per row
+// hybridMergeRuns: column c after steps 2-3. The transpose gives it rows c, c + s, ... of
+// every column, i.e. s sorted runs of r/s keys, which are merged in place of the sort
+// straight from matrix, with the transpose folded into the stride
+// hybridSplit: multiwaySplit of runs at rank. Step 4 (untranspose) would leave every key
+// within (s-1)^2 of its place in column-major order, so the key of rank rank is one of the
+// keys step 4 puts in that window around rank; they bound the search, and are read from
+// runs without doing step 4
+void hybridMergeRuns(int **matrix, size_t r, size_t s, size_t c, int *out);
+void hybridSplit(int **runs, size_t r, size_t s, size_t rank, size_t *pos);
@@ -0,0 +1,304 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include "columnSort.h"
+
+// auto-tuning for columnsort: reads the cache topology and core count from sysfs,
+// runs short calibration sorts to pick a column size and a thread count, and
+// persists both in a small text profile that columnSortChooseShape reads back
+
+#define CALIBRATION_N (1 << 20)
+#define MAX_SHAPES 64
+
+typedef struct tuneProfile {
+  long l1d, l2, l3;         // data cache sizes in bytes, 0 if unknown
+  int physicalCores;
+  int logicalCpus;
+  int threads;              // best thread count from calibration
+  long columnBytes;         // best r * sizeof(int) from calibration
+} tuneProfile;
+
+static tuneProfile profile;
+static int profileLoaded = 0;
+
+// profile location: $COLUMNSORT_PROFILE, else ~/.columnsort-profile, else the current directory
+static void profilePath(const char *path, char *buf, int len) {
+  const char *home = getenv("HOME");
+  if (path) {
+    snprintf(buf, len, "%s", path);
+  } else if (getenv("COLUMNSORT_PROFILE")) {
+    snprintf(buf, len, "%s", getenv("COLUMNSORT_PROFILE"));
+  } else if (home) {
+    snprintf(buf, len, "%s/.columnsort-profile", home);
+  } else {
+    snprintf(buf, len, ".columnsort-profile");
+  }
+}
+
+// read a sysfs value such as "48K", "2048K" or "32M" as bytes; -1 if missing
+static long readSysfs(const char *path) {
+  char buf[64], *end;
+  long value;
+  FILE *fp = fopen(path, "r");
+  if (!fp) {
+    return -1;
+  }
+  if (!fgets(buf, sizeof(buf), fp)) {
+    fclose(fp);
+    return -1;
+  }
+  fclose(fp);
+  value = strtol(buf, &end, 10);
+  if (*end == 'K') {
+    value *= 1024;
+  } else if (*end == 'M') {
+    value *= 1024 * 1024;
+  }
+  return value;
+}
+
+static void readTopology(tuneProfile *p) {
+  char path[256], type[32];
+  int i, j, cpu, count = 0;
+  static int seen[4096][2];
+
+  p->l1d = p->l2 = p->l3 = 0;
+  for (i = 0; i < 8; i++) {
+    FILE *fp;
+    long level, size;
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu0/cache/index%d/type", i);
+    fp = fopen(path, "r");
+    if (!fp) {
+      break;
+    }
+    if (!fgets(type, sizeof(type), fp)) {
+      type[0] = '\0';
+    }
+    fclose(fp);
+    if (strncmp(type, "Instruction", 11) == 0) {
+      continue;
+    }
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu0/cache/index%d/level", i);
+    level = readSysfs(path);
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu0/cache/index%d/size", i);
+    size = readSysfs(path);
+    if (level == 1) {
+      p->l1d = size;
+    } else if (level == 2) {
+      p->l2 = size;
+    } else if (level == 3) {
+      p->l3 = size;
+    }
+  }
+
+  // physical cores are the distinct (package, core) pairs among the online cpus
+  p->logicalCpus = (int) sysconf(_SC_NPROCESSORS_ONLN);
+  for (cpu = 0; cpu < 4096; cpu++) {
+    long core, package;
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/core_id", cpu);
+    core = readSysfs(path);
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/physical_package_id", cpu);
+    package = readSysfs(path);
+    if (core < 0 || package < 0) {
+      continue;
+    }
+    for (j = 0; j < count && (seen[j][0] != package || seen[j][1] != core); j++);
+    if (j == count) {
+      seen[count][0] = (int) package;
+      seen[count][1] = (int) core;
+      count++;
+    }
+  }
+  p->physicalCores = (count > 0) ? count : p->logicalCpus;
+}
+
+// defaults when there is no profile: a column that fills half of L2, one thread per core
+static void defaultProfile(tuneProfile *p) {
+  readTopology(p);
+  p->threads = p->physicalCores;
+  p->columnBytes = (p->l2 > 0) ? p->l2 / 2 : 256 * 1024;
+}
+
+static int loadProfile(const char *path) {
+  char file[512], key[64];
+  long value;
+  FILE *fp;
+
+  defaultProfile(&profile);
+  profilePath(path, file, sizeof(file));
+  fp = fopen(file, "r");
+  if (!fp) {
+    return -1;
+  }
+  while (fscanf(fp, "%63s %ld", key, &value) == 2) {
+    if (strcmp(key, "l1d") == 0) {
+      profile.l1d = value;
+    } else if (strcmp(key, "l2") == 0) {
+      profile.l2 = value;
+    } else if (strcmp(key, "l3") == 0) {
+      profile.l3 = value;
+    } else if (strcmp(key, "physicalCores") == 0) {
+      profile.physicalCores = (int) value;
+    } else if (strcmp(key, "logicalCpus") == 0) {
+      profile.logicalCpus = (int) value;
+    } else if (strcmp(key, "threads") == 0) {
+      profile.threads = (int) value;
+    } else if (strcmp(key, "columnBytes") == 0) {
+      profile.columnBytes = value;
+    }
+  }
+  fclose(fp);
+  return 0;
+}
+
+// valid columnsort shapes for n, most columns first: s | n, s | r and r >= 2(s-1)^2
+// the constraint is checked as (s-1)^2 <= r/2, which cannot overflow since s <= sqrt(n)
+static int validShapes(size_t n, size_t *shapes, int maxShapes) {
+  size_t s = (size_t) sqrt((double) n);
+  int count = 0;
+
+  // correct the floating-point square root so that s*s <= n < (s+1)*(s+1)
+  while (s > 0 && s * s > n) {
+    s--;
+  }
+  while ((s + 1) * (s + 1) <= n) {
+    s++;
+  }
+  for (; s >= 1 && count < maxShapes; s--) {
+    size_t r = n / s;
+    if (n % s == 0 && r % s == 0 && (s - 1) * (s - 1) <= r / 2) {
+      shapes[count++] = s;
+    }
+  }
+  return count;
+}
+
+void columnSortDefaultShape(size_t n, size_t *length, size_t *width) {
+  size_t s = 1;
+  validShapes(n, &s, 1);
+  *width = s;
+  *length = n / s;
+}
+
+static double timeSort(int *work, int *input, size_t n, int threads, size_t s) {
+  double elapsed;
+  memcpy(work, input, n * sizeof(int));
+  columnSort64(work, threads, n / s, s, &elapsed);
+  return elapsed;
+}
+
+int columnSortTune(const char *path) {
+  char file[512];
+  size_t shapes[MAX_SHAPES];
+  size_t bestS, k, n = CALIBRATION_N;
+  int i, t, numShapes;
+  double best, elapsed;
+  int *input, *work;
+  FILE *fp;
+
+  defaultProfile(&profile);
+  input = (int *) malloc(n * sizeof(int));
+  work = (int *) malloc(n * sizeof(int));
+  if (!input || !work) {
+    free(input);
+    free(work);
+    return -1;
+  }
+  srand(422);
+  for (k = 0; k < n; k++) {
+    input[k] = rand();
+  }
+
+  // pass 1: with one thread per physical core, find the column size that sorts fastest
+  numShapes = validShapes(n, shapes, MAX_SHAPES);
+  bestS = shapes[0];
+  best = -1.0;
+  for (i = 0; i < numShapes; i++) {
+    int threads = ((size_t) profile.physicalCores < shapes[i]) ? profile.physicalCores : (int) shapes[i];
+    elapsed = timeSort(work, input, n, threads, shapes[i]);
+    if (best < 0.0 || elapsed < best) {
+      best = elapsed;
+      bestS = shapes[i];
+    }
+  }
+  profile.columnBytes = (long) (n / bestS) * sizeof(int);
+
+  // pass 2: at that shape, powers of two below the logical cpu count, the physical
+  // core count and the logical cpu count
+  int candidates[MAX_SHAPES], numCandidates = 0;
+  for (t = 1; t < profile.logicalCpus && numCandidates < MAX_SHAPES - 2; t *= 2) {
+    candidates[numCandidates++] = t;
+  }
+  candidates[numCandidates++] = profile.physicalCores;
+  candidates[numCandidates++] = profile.logicalCpus;
+  best = -1.0;
+  for (i = 0; i < numCandidates; i++) {
+    int j;
+    t = candidates[i];
+    for (j = 0; j < i && candidates[j] != t; j++);
+    if ((size_t) t > bestS || j < i) {
+      continue;
+    }
+    elapsed = timeSort(work, input, n, t, bestS);
+    if (best < 0.0 || elapsed < best) {
+      best = elapsed;
+      profile.threads = t;
+    }
+  }
+  free(input);
+  free(work);
+
+  profilePath(path, file, sizeof(file));
+  fp = fopen(file, "w");
+  if (!fp) {
+    return -1;
+  }
+  fprintf(fp, "l1d %ld\nl2 %ld\nl3 %ld\n", profile.l1d, profile.l2, profile.l3);
+  fprintf(fp, "physicalCores %d\nlogicalCpus %d\n", profile.physicalCores, profile.logicalCpus);
+  fprintf(fp, "threads %d\ncolumnBytes %ld\n", profile.threads, profile.columnBytes);
+  fclose(fp);
+  profileLoaded = 1;
+  return 0;
+}
+
+// pick the valid shape whose column size is nearest (by ratio) to the tuned column size,
+// and a thread count that does not exceed the number of columns; -1 if n has no valid shape
+int columnSortChooseShape(size_t n, size_t *length, size_t *width, int *numThreads) {
+  size_t shapes[MAX_SHAPES];
+  int i, numShapes, best = -1;
+  double bestRatio = 0.0;
+
+  if (!profileLoaded) {
+    loadProfile(NULL);
+    profileLoaded = 1;
+  }
+  numShapes = validShapes(n, shapes, MAX_SHAPES);
+  for (i = 0; i < numShapes; i++) {
+    double bytes = (double) (n / shapes[i]) * sizeof(int);
+    double ratio = (bytes > profile.columnBytes) ? bytes / profile.columnBytes : profile.columnBytes / bytes;
+    if (best < 0 || ratio < bestRatio) {
+      best = i;
+      bestRatio = ratio;
+    }
+  }
+  if (best < 0) {
+    return -1;
+  }
+  *width = shapes[best];
+  *length = n / shapes[best];
+  *numThreads = ((size_t) profile.threads < *width) ? profile.threads : (int) *width;
+  return 0;
+}
+
+void columnSortAuto(int *A, size_t n, double *elapsedTime) {
+  size_t r, s;
+  int threads;
+  if (columnSortChooseShape(n, &r, &s, &threads) != 0) {
+    fprintf(stderr, "columnSortAuto: n = %zu has no valid columnsort shape\n", n);
+    exit(1);
+  }
+  columnSort64(A, threads, r, s, elapsedTime);
+}
@@ -2,77 +2,384 @@
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <pthread.h>
+
+#ifdef USE_MPI
+#include <mpi.h>
+#endif
 
 #include "columnSort.h"
 
-static void initData(int *A, int n) {
+// input distributions selectable with -dist=; "mod1000" is the original rand() % 1000 data
+#define ZIPF_VALUES 65536
+#define SAWTOOTH_PERIOD 4096
+
+static const char *distNames[] = {"mod1000", "uniform", "few", "zipf", "sorted", "reverse", "sawtooth", NULL};
+
+// splitmix64, so the wider distributions get all 32 bits regardless of RAND_MAX
+static unsigned long long randState = 422;
+static unsigned long long nextRandom() {
+  unsigned long long z = (randState += 0x9e3779b97f4a7c15ULL);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+// Zipf with exponent 1 over ZIPF_VALUES ranks, drawn by binary search of the cumulative distribution
+static void initZipf(int *A, size_t n) {
+  size_t i;
+  int lo, hi, mid;
+  double *cdf = (double *) malloc(ZIPF_VALUES * sizeof(double));
+  double total = 0.0;
+
+  for (i = 0; i < ZIPF_VALUES; i++) {
+    total += 1.0 / (i + 1.0);
+    cdf[i] = total;
+  }
+  for (i = 0; i < n; i++) {
+    double u = (nextRandom() >> 11) * (1.0 / 9007199254740992.0) * total;
+    lo = 0;
+    hi = ZIPF_VALUES - 1;
+    while (lo < hi) {
+      mid = (lo + hi) / 2;
+      if (cdf[mid] < u) {
+        lo = mid + 1;
+      } else {
+        hi = mid;
+      }
+    }
+    A[i] = lo;
+  }
+  free(cdf);
+}
+
+static void initData(int *A, size_t n, const char *dist) {
   srand(422);
+  randState = 422;
 
-  int i;
+  size_t i;
 
+  if (strcmp(dist, "zipf") == 0) {
+    initZipf(A, n);
+    return;
+  }
   for (i = 0; i < n; i++) {
-    A[i] = rand() % 1000;
+    if (dist[0] == 'u') {         // uniform
+      A[i] = (int) (unsigned int) nextRandom();
+    } else if (dist[0] == 'f') {  // few
+      A[i] = (int) (nextRandom() % 16);
+    } else if (dist[0] == 's' && dist[1] == 'o') {  // sorted
+      A[i] = (int) i;
+    } else if (dist[0] == 'r') {  // reverse
+      A[i] = (int) (n - i);
+    } else if (dist[0] == 's') {  // sawtooth
+      A[i] = (int) (i % SAWTOOTH_PERIOD);
+    } else {
+      A[i] = rand() % 1000;
+    }
   }
 }
 
+// no subtraction, so the full int range compares correctly
 int driverCompareInts(const void *a, const void *b) {
-  return *((int *) a) - *((int *) b);
+  int x = *((int *) a), y = *((int *) b);
+  return (x > y) - (x < y);
+}
+
+// low-memory verification (-verify=hash): instead of a sorted copy, each of
+// numWorkers threads hashes its slice of the input before and after the sort,
+// and checks its slice (plus the boundary with the previous one) is in order.
+// The multiset hash is a sum of mixed keys, so it does not depend on order;
+// two independent sums make an accidental match on a wrong output negligible
+typedef struct verifyArgs {
+  int *A;
+  size_t lo, hi;
+  unsigned long long hash1, hash2;
+  long long unsortedAt;  // first i with A[i-1] > A[i], or -1
+} verifyArgs;
+
+static unsigned long long mixKey(unsigned long long x, unsigned long long seed) {
+  x += seed;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+static void *hashWorker(void *arg) {
+  verifyArgs *va = (verifyArgs *) arg;
+  unsigned long long h1 = 0, h2 = 0;
+  size_t i;
+  for (i = va->lo; i < va->hi; i++) {
+    h1 += mixKey((unsigned int) va->A[i], 0x9e3779b97f4a7c15ULL);
+    h2 += mixKey((unsigned int) va->A[i], 0xd1b54a32d192ed03ULL);
+  }
+  va->hash1 = h1;
+  va->hash2 = h2;
+  return NULL;
+}
+
+static void *sortedWorker(void *arg) {
+  verifyArgs *va = (verifyArgs *) arg;
+  size_t i;
+  va->unsortedAt = -1;
+  for (i = (va->lo > 0) ? va->lo : 1; i < va->hi; i++) {
+    if (va->A[i - 1] > va->A[i]) {
+      va->unsortedAt = (long long) i;
+      break;
+    }
+  }
+  hashWorker(arg);
+  return NULL;
+}
+
+// run fn over numThreads slices of A and combine the results into *total
+static void parallelVerify(int *A, size_t n, int numThreads, void *(*fn)(void *), verifyArgs *total) {
+  int t;
+  pthread_t *handles = (pthread_t *) malloc(numThreads * sizeof(pthread_t));
+  verifyArgs *args = (verifyArgs *) malloc(numThreads * sizeof(verifyArgs));
+
+  for (t = 0; t < numThreads; t++) {
+    args[t].A = A;
+    args[t].lo = n / numThreads * t + ((size_t) t < n % numThreads ? (size_t) t : n % numThreads);
+    args[t].hi = args[t].lo + n / numThreads + ((size_t) t < n % numThreads ? 1 : 0);
+    pthread_create(&handles[t], NULL, fn, &args[t]);
+  }
+  total->hash1 = total->hash2 = 0;
+  total->unsortedAt = -1;
+  for (t = 0; t < numThreads; t++) {
+    pthread_join(handles[t], NULL);
+    total->hash1 += args[t].hash1;
+    total->hash2 += args[t].hash2;
+    if (fn == sortedWorker && total->unsortedAt < 0) {
+      total->unsortedAt = args[t].unsortedAt;
+    }
+  }
+  free(handles);
+  free(args);
+}
+
+// print the per-step, per-thread table recorded by columnSort as CSV or JSON
+static void dumpStats(FILE *fp, int json) {
+  int t, step;
+  int threads = columnSortStatsThreads();
+  int steps = columnSortStatsSteps();
+
+  if (json) {
+    fprintf(fp, "[");
+  } else {
+    fprintf(fp, "thread,step,name,computeTime,barrierTime,cacheMisses,instructions\n");
+  }
+  for (t = 0; t < threads; t++) {
+    for (step = 1; step <= steps; step++) {
+      const stepStats *st = columnSortGetStats(t, step);
+      if (json) {
+        fprintf(fp, "%s\n  {\"thread\": %d, \"step\": %d, \"name\": \"%s\", \"computeTime\": %.9f, "
+                "\"barrierTime\": %.9f, \"cacheMisses\": %lld, \"instructions\": %lld}",
+                (t == 0 && step == 1) ? "" : ",", t, step, columnSortStepName(step),
+                st->computeTime, st->barrierTime, st->cacheMisses, st->instructions);
+      } else {
+        fprintf(fp, "%d,%d,%s,%.9f,%.9f,%lld,%lld\n", t, step, columnSortStepName(step),
+                st->computeTime, st->barrierTime, st->cacheMisses, st->instructions);
+      }
+    }
+  }
+  if (json) {
+    fprintf(fp, "\n]\n");
+  }
 }
 
 int main(int argc, char *argv[]) {
-  int i, n, r, s, numWorkers;
-  int *inputArray, *sortedArray;
+  int i, numWorkers;
+  size_t j, n, r, s;
+  int *inputArray = NULL, *sortedArray = NULL;
   double elapsedTime;
+  int myRank = 0;
+  int statsMode = 0;  // 0 none, 1 csv, 2 json
+  int precise = 0;
+  size_t forceS = 0;
+  const char *dist = "mod1000";
+  int hashVerify = 0;
+  int memMode = CS_MEM_MALLOC, populate = 0;
+  verifyArgs before, after;
+
+#ifdef USE_MPI
+  // every rank runs the driver, but only rank 0 owns the input and checks the result
+  MPI_Init(&argc, &argv);
+  MPI_Comm_rank(MPI_COMM_WORLD, &myRank);
+#endif
+
+  // "-tune [profile]" calibrates this machine and writes the profile used by auto mode
+  if (argc > 1 && strcmp(argv[1], "-tune") == 0) {
+#ifdef USE_MPI
+    if (myRank == 0) {
+      fprintf(stderr, "tuning is only supported by the shared-memory builds\n");
+    }
+    MPI_Finalize();
+    return 1;
+#else
+    if (columnSortTune(argc > 2 ? argv[2] : NULL) != 0) {
+      fprintf(stderr, "tuning failed\n");
+      return 1;
+    }
+    printf("profile written\n");
+    return 0;
+#endif
+  }
 
   // read command line; note for sequential version numWorkers will be 1
-  n = atoi(argv[1]);
+  // numWorkers of 0 means auto: shape and thread count come from the tuning profile
+  n = (size_t) strtoull(argv[1], NULL, 10);
   numWorkers = atoi(argv[2]);
 
-  /* figure out r and s such that r and s are as close as possible satisfying columnsort constraints */
-  i = 1;
-  s = 0;
-  while (i <= (int) sqrt(n/2)) {
-    if (n % i == 0)
-      s = i;
-    i++;
+  // optional flags after n and numWorkers
+  //   -stats=csv or -stats=json  dump the per-step instrumentation after the run
+  //   -dist=NAME                 input distribution (see distNames)
+  //   -s=S                       use s columns instead of the default shape
+  //   -precise                   print elapsedTime with nanosecond digits (used by bench)
+  //   -verify=full or -verify=hash  compare against a qsorted copy (default), or check
+  //                              order and a multiset hash in parallel with O(threads) memory
+  //   -mem=malloc|thp|hugetlb    how the working matrices, and the scratch array of sample sort
+  //                              and merge sort, are allocated (see columnSortSetMemory)
+  //   -populate                  pre-fault the working matrices before the timer starts
+  //   -engine=NAME               columnsort (default), samplesort, mergesort or hybrid
+  for (i = 3; i < argc; i++) {
+    if (strcmp(argv[i], "-stats=csv") == 0) {
+      statsMode = 1;
+    } else if (strcmp(argv[i], "-stats=json") == 0) {
+      statsMode = 2;
+    } else if (strncmp(argv[i], "-dist=", 6) == 0) {
+      int d;
+      dist = argv[i] + 6;
+      for (d = 0; distNames[d] && strcmp(distNames[d], dist) != 0; d++);
+      if (!distNames[d]) {
+        if (myRank == 0) {
+          fprintf(stderr, "unknown distribution %s\n", dist);
+        }
+        exit(1);
+      }
+    } else if (strncmp(argv[i], "-s=", 3) == 0) {
+      forceS = (size_t) strtoull(argv[i] + 3, NULL, 10);
+    } else if (strcmp(argv[i], "-precise") == 0) {
+      precise = 1;
+    } else if (strcmp(argv[i], "-verify=hash") == 0) {
+      hashVerify = 1;
+    } else if (strcmp(argv[i], "-verify=full") == 0) {
+      hashVerify = 0;
+    } else if (strcmp(argv[i], "-mem=malloc") == 0) {
+      memMode = CS_MEM_MALLOC;
+    } else if (strcmp(argv[i], "-mem=thp") == 0) {
+      memMode = CS_MEM_THP;
+    } else if (strcmp(argv[i], "-mem=hugetlb") == 0) {
+      memMode = CS_MEM_HUGETLB;
+    } else if (strcmp(argv[i], "-populate") == 0) {
+      populate = 1;
+    } else if (strncmp(argv[i], "-engine=", 8) == 0) {
+      if (columnSortSetEngine(columnSortEngineByName(argv[i] + 8)) != 0) {
+        if (myRank == 0) {
+          fprintf(stderr, "unknown engine %s\n", argv[i] + 8);
+        }
+        exit(1);
+      }
+    } else if (myRank == 0) {
+      fprintf(stderr, "ignoring unknown option %s\n", argv[i]);
+    }
   }
+  columnSortEnableStats(statsMode != 0);
+  columnSortSetMemory(memMode, populate);
 
-  r = n/s;
+  /* figure out r and s such that r and s are as close as possible satisfying columnsort constraints */
+  columnSortDefaultShape(n, &r, &s);
+
+  // an explicit shape must satisfy the columnsort constraints exactly
+  if (forceS > 0) {
+    s = forceS;
+    r = n / s;
+    if (n % s != 0 || r % s != 0 || (s - 1) * (s - 1) > r / 2) {
+      if (myRank == 0) {
+        fprintf(stderr, "s = %zu is not a valid shape for n = %zu\n", s, n);
+      }
+      exit(1);
+    }
+  }
 
-  while (r < 2 * pow(s - 1, 2)) {
-    r = r * 2;
-    s = s / 2;
+  if (numWorkers == 0) {
+    if (columnSortChooseShape(n, &r, &s, &numWorkers) != 0) {
+      if (myRank == 0) {
+        fprintf(stderr, "n = %zu has no valid columnsort shape\n", n);
+      }
+      exit(1);
+    }
+    if (myRank == 0) {
+      printf("auto: r = %zu, s = %zu, threads = %d\n", r, s, numWorkers);
+    }
   }
 
-  inputArray = (int *) malloc (n * sizeof(int));
-  sortedArray = (int *) malloc (n * sizeof(int));
+  if (myRank == 0) {
+    inputArray = (int *) malloc (n * sizeof(int));
 
-  initData(inputArray, n);
+    initData(inputArray, n, dist);
 
-  /* create a sorted copy of the input array */
-  memcpy(sortedArray, inputArray, n * sizeof(int));
-  qsort(sortedArray, n, sizeof(int), driverCompareInts);
+    if (hashVerify) {
+      parallelVerify(inputArray, n, (numWorkers > 0) ? numWorkers : 1, hashWorker, &before);
+    } else {
+      /* create a sorted copy of the input array */
+      sortedArray = (int *) malloc (n * sizeof(int));
+      memcpy(sortedArray, inputArray, n * sizeof(int));
+      qsort(sortedArray, n, sizeof(int), driverCompareInts);
+    }
+  }
 
   // this is the function you must implement
-  columnSort(inputArray, numWorkers, r, s, &elapsedTime);
+  columnSort64(inputArray, numWorkers, r, s, &elapsedTime);
 
   // just error checking here
-  for (i = 0; i < n; i++) {
-    if (sortedArray[i] != inputArray[i]) {
-      printf("error at position %d; correct value is %d; your value is %d\n", i, sortedArray[i], inputArray[i]);
-
+  if (myRank == 0 && hashVerify) {
+    parallelVerify(inputArray, n, (numWorkers > 0) ? numWorkers : 1, sortedWorker, &after);
+    if (after.unsortedAt >= 0 || after.hash1 != before.hash1 || after.hash2 != before.hash2) {
+      if (after.unsortedAt >= 0) {
+        printf("error at position %lld; %d is out of order after %d\n", after.unsortedAt,
+               inputArray[after.unsortedAt], inputArray[after.unsortedAt - 1]);
+      } else {
+        printf("error: output is not a permutation of the input\n");
+      }
       free(inputArray);
-      free(sortedArray);
-
+#ifdef USE_MPI
+      MPI_Abort(MPI_COMM_WORLD, 1);
+#endif
       exit(1);
     }
   }
+  if (myRank == 0) {
+    for (j = 0; !hashVerify && j < n; j++) {
+      if (sortedArray[j] != inputArray[j]) {
+        printf("error at position %zu; correct value is %d; your value is %d\n", j, sortedArray[j], inputArray[j]);
+
+        free(inputArray);
+        free(sortedArray);
+
+#ifdef USE_MPI
+        MPI_Abort(MPI_COMM_WORLD, 1);
+#endif
+        exit(1);
+      }
+    }
 
-  printf("correct\n");
-  printf("elapsedTime is %.3f\n", elapsedTime);
+    printf("correct\n");
+    printf(precise ? "elapsedTime is %.9f\n" : "elapsedTime is %.3f\n", elapsedTime);
+    if (memMode != CS_MEM_MALLOC) {
+      printf("hugePages is %ld\n", columnSortHugePages());
+    }
+    if (statsMode) {
+      dumpStats(stdout, statsMode == 2);
+    }
+
+    free(inputArray);
+    free(sortedArray);
+  }
 
-  free(inputArray);
-  free(sortedArray);
+#ifdef USE_MPI
+  MPI_Finalize();
+#endif
 
   return 0;
 }
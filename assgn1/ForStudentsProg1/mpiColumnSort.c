@@ -0,0 +1,350 @@
+#include <mpi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "columnSort.h"
+#include "columnSortHelper.h"
+
+#define NUM_STEPS 6
+
+// names of the steps, for the instrumentation table; each rank records only itself
+static const char *stepNames[NUM_STEPS] = {
+    "sort", "transpose", "sort", "untranspose", "sort", "shift-merge"
+};
+
+// distributed columnsort: every rank owns a contiguous block of columns and
+// stores them column major, so each local column is one contiguous run of rows ints
+int myRank, numProcs;
+size_t rows, cols;
+int *localCols;
+
+// MPI counts are int, so a rank can exchange at most INT_MAX ints in one call
+int toCount(size_t count) {
+    if (count > INT_MAX) {
+        fprintf(stderr, "rank %d: %zu ints is too many for one MPI message; use more ranks\n", myRank, count);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    return (int) count;
+}
+
+// use same comparator as driver
+int compareInts(const void *a, const void *b) {
+    int x = *((int *) a), y = *((int *) b);
+    return (x > y) - (x < y);
+}
+
+// same column split the threaded version uses, but per rank instead of per thread
+void ownedCols(int id, size_t *startCol, size_t *endCol) {
+    size_t baseCols = cols / numProcs;
+    size_t extraCols = cols % numProcs;
+
+    if ((size_t) id < extraCols) {
+        *startCol = id * (baseCols + 1);
+        *endCol = *startCol + baseCols + 1;
+    } else {
+        *startCol = id * baseCols + extraCols;
+        *endCol = *startCol + baseCols;
+    }
+}
+
+// rank that owns a given column
+int colOwner(size_t col) {
+    int p;
+    size_t startCol, endCol;
+    for (p = 0; p < numProcs; p++) {
+        ownedCols(p, &startCol, &endCol);
+        if (col >= startCol && col < endCol) {
+            return p;
+        }
+    }
+    return -1;
+}
+
+// Sort each local column individually; columns are contiguous so no temp copy is needed
+void columnSortInd(int *local, size_t numCols) {
+    for (size_t j = 0; j < numCols; j++) {
+        qsort(&local[j * rows], rows, sizeof(int), compareInts);
+    }
+}
+
+// local columns lo up to hi of a rank with count columns that go in batch k of the
+// transpose pipeline; every rank runs the same number of batches, some possibly empty
+#define PIPELINE_BATCHES 4
+
+void batchCols(size_t count, int k, size_t *lo, size_t *hi) {
+    *lo = count * k / PIPELINE_BATCHES;
+    *hi = count * (k + 1) / PIPELINE_BATCHES;
+}
+
+// step 1 and step 2 (step == 2), or step 3 and step 4 (step == 4), pipelined: the local
+// columns are sorted a batch at a time, and each sorted batch is packed and sent with a
+// non-blocking all-to-all while the next batch is sorted; batches are unpacked as they
+// arrive. Sort time is recorded under step - 1 and the exchange under step
+// step 2: row i of column j lands in column i % s, row j*(r/s) + i/s
+// step 4: the inverse, row j*(r/s) + t of column b lands in column j, row t*s + b
+void sortAndTranspose(int step) {
+    int p, q, k;
+    size_t j, b, t, index, lo, hi;
+    size_t myStart, myEnd, qStart, qEnd, pStart, pEnd;
+    size_t seg = rows / cols;
+    int *sendCounts = (int *)malloc(PIPELINE_BATCHES * numProcs * sizeof(int));
+    int *sendDispls = (int *)malloc(PIPELINE_BATCHES * numProcs * sizeof(int));
+    int *recvCounts = (int *)malloc(PIPELINE_BATCHES * numProcs * sizeof(int));
+    int *recvDispls = (int *)malloc(PIPELINE_BATCHES * numProcs * sizeof(int));
+    MPI_Request reqs[PIPELINE_BATCHES];
+    double sortTime = 0.0, t0 = csNow();
+
+    ownedCols(myRank, &myStart, &myEnd);
+    size_t myCount = myEnd - myStart;
+    int *sendBuf = (int *)malloc(myCount * rows * sizeof(int) + 1);
+    int *recvBuf = (int *)malloc(myCount * rows * sizeof(int) + 1);
+
+    // receive layout: batch by batch, and within a batch by source rank
+    index = 0;
+    for (k = 0; k < PIPELINE_BATCHES; k++) {
+        for (p = 0; p < numProcs; p++) {
+            ownedCols(p, &pStart, &pEnd);
+            batchCols(pEnd - pStart, k, &lo, &hi);
+            recvDispls[k * numProcs + p] = toCount(index);
+            recvCounts[k * numProcs + p] = toCount(myCount * (hi - lo) * seg);
+            index += myCount * (hi - lo) * seg;
+        }
+    }
+
+    index = 0;
+    for (k = 0; k < PIPELINE_BATCHES; k++) {
+        batchCols(myCount, k, &lo, &hi);
+        double sortStart = csNow();
+        columnSortInd(&localCols[lo * rows], hi - lo);
+        sortTime += csNow() - sortStart;
+
+        // pack one segment of every column of the batch for each destination column, in
+        // destination order
+        for (q = 0; q < numProcs; q++) {
+            ownedCols(q, &qStart, &qEnd);
+            sendDispls[k * numProcs + q] = toCount(index);
+            for (b = qStart; b < qEnd; b++) {
+                for (j = lo; j < hi; j++) {
+                    for (t = 0; t < seg; t++) {
+                        if (step == 2) {
+                            sendBuf[index++] = localCols[j * rows + b + t * cols];
+                        } else {
+                            sendBuf[index++] = localCols[j * rows + b * seg + t];
+                        }
+                    }
+                }
+            }
+            sendCounts[k * numProcs + q] = toCount(index - sendDispls[k * numProcs + q]);
+        }
+        MPI_Ialltoallv(sendBuf, &sendCounts[k * numProcs], &sendDispls[k * numProcs], MPI_INT,
+                       recvBuf, &recvCounts[k * numProcs], &recvDispls[k * numProcs], MPI_INT,
+                       MPI_COMM_WORLD, &reqs[k]);
+    }
+
+    // every column is packed, so localCols can be overwritten; unpack each batch as it
+    // completes. From each source rank a batch holds [my column][its column][segment]
+    for (int done = 0; done < PIPELINE_BATCHES; done++) {
+        MPI_Waitany(PIPELINE_BATCHES, reqs, &k, MPI_STATUS_IGNORE);
+        for (p = 0; p < numProcs; p++) {
+            ownedCols(p, &pStart, &pEnd);
+            batchCols(pEnd - pStart, k, &lo, &hi);
+            index = recvDispls[k * numProcs + p];
+            for (j = 0; j < myCount; j++) {
+                for (b = pStart + lo; b < pStart + hi; b++) {
+                    for (t = 0; t < seg; t++) {
+                        if (step == 2) {
+                            localCols[j * rows + b * seg + t] = recvBuf[index++];
+                        } else {
+                            localCols[j * rows + t * cols + b] = recvBuf[index++];
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    statsAdd(0, step - 1, sortTime, 0.0, -1, -1);
+    statsAdd(0, step, csNow() - t0 - sortTime, 0.0, -1, -1);
+    free(sendBuf);
+    free(recvBuf);
+    free(sendCounts);
+    free(sendDispls);
+    free(recvCounts);
+    free(recvDispls);
+}
+
+// merge the two sorted runs lo (loLen) and hi (hiLen); the smallest loLen values
+// go to loOut and the largest hiLen values go to hiOut (either output may be NULL)
+void mergeBoundary(int *lo, size_t loLen, int *hi, size_t hiLen, int *loOut, int *hiOut, int *temp) {
+    size_t a = 0, b = 0, index = 0;
+    while (a < loLen && b < hiLen) {
+        temp[index++] = (lo[a] <= hi[b]) ? lo[a++] : hi[b++];
+    }
+    while (a < loLen) {
+        temp[index++] = lo[a++];
+    }
+    while (b < hiLen) {
+        temp[index++] = hi[b++];
+    }
+    if (loOut) {
+        memcpy(loOut, temp, loLen * sizeof(int));
+    }
+    if (hiOut) {
+        memcpy(hiOut, temp + loLen, hiLen * sizeof(int));
+    }
+}
+
+// steps 6 through 8: shifting by floor(r/2) pairs the bottom half of column c-1
+// with the top half of column c; both halves are sorted after step 5, so sorting
+// the shifted column is a merge and unshifting writes the halves straight back.
+// The two boundary columns owned by neighbour ranks are exchanged with
+// non-blocking sends, and the interior boundaries are merged while they are in flight
+void shiftMerge() {
+    int prevRank, nextRank, numReqs = 0;
+    size_t myStart, myEnd, c;
+    size_t shift = rows / 2;
+    size_t topLen = rows - shift;
+    MPI_Request reqs[4];
+
+    ownedCols(myRank, &myStart, &myEnd);
+    size_t myCount = myEnd - myStart;
+    if (myCount == 0) {
+        return;
+    }
+    prevRank = (myStart > 0) ? colOwner(myStart - 1) : -1;
+    nextRank = (myEnd < cols) ? colOwner(myEnd) : -1;
+
+    int *fromPrev = (int *)malloc((shift + 1) * sizeof(int));
+    int *fromNext = (int *)malloc((topLen + 1) * sizeof(int));
+    int *temp = (int *)malloc(rows * sizeof(int));
+    int *firstCol = localCols;
+    int *lastCol = &localCols[(myCount - 1) * rows];
+
+    // my first column's top half goes left, my last column's bottom half goes right
+    if (prevRank >= 0) {
+        MPI_Irecv(fromPrev, toCount(shift), MPI_INT, prevRank, 0, MPI_COMM_WORLD, &reqs[numReqs++]);
+        MPI_Isend(firstCol, toCount(topLen), MPI_INT, prevRank, 1, MPI_COMM_WORLD, &reqs[numReqs++]);
+    }
+    if (nextRank >= 0) {
+        MPI_Irecv(fromNext, toCount(topLen), MPI_INT, nextRank, 1, MPI_COMM_WORLD, &reqs[numReqs++]);
+        MPI_Isend(&lastCol[topLen], toCount(shift), MPI_INT, nextRank, 0, MPI_COMM_WORLD, &reqs[numReqs++]);
+    }
+
+    // interior boundaries never touch the halves that are being sent
+    for (c = 1; c < myCount; c++) {
+        int *left = &localCols[(c - 1) * rows];
+        int *right = &localCols[c * rows];
+        mergeBoundary(&left[topLen], shift, right, topLen, &left[topLen], right, temp);
+    }
+
+    MPI_Waitall(numReqs, reqs, MPI_STATUSES_IGNORE);
+
+    // both neighbours merge the same boundary; each keeps only its own half
+    if (prevRank >= 0) {
+        mergeBoundary(fromPrev, shift, firstCol, topLen, NULL, firstCol, temp);
+    }
+    if (nextRank >= 0) {
+        mergeBoundary(&lastCol[topLen], shift, fromNext, topLen, &lastCol[topLen], NULL, temp);
+    }
+
+    free(fromPrev);
+    free(fromNext);
+    free(temp);
+}
+
+// rank 0 sends (toRoot == 0) or receives (toRoot == 1) every rank's block of columns;
+// point-to-point rather than Scatterv/Gatherv because the displacements of a
+// 64-bit sized matrix do not fit in an int even when each block does
+void exchangeBlocks(int *all, int toRoot) {
+    int p;
+    size_t pStart, pEnd;
+    MPI_Request *reqs = (MPI_Request *)malloc(numProcs * sizeof(MPI_Request));
+
+    if (myRank == 0) {
+        for (p = 1; p < numProcs; p++) {
+            ownedCols(p, &pStart, &pEnd);
+            if (toRoot) {
+                MPI_Irecv(&all[pStart * rows], toCount((pEnd - pStart) * rows), MPI_INT, p, 2, MPI_COMM_WORLD, &reqs[p - 1]);
+            } else {
+                MPI_Isend(&all[pStart * rows], toCount((pEnd - pStart) * rows), MPI_INT, p, 2, MPI_COMM_WORLD, &reqs[p - 1]);
+            }
+        }
+        ownedCols(0, &pStart, &pEnd);
+        if (toRoot) {
+            memcpy(all, localCols, (pEnd - pStart) * rows * sizeof(int));
+        } else {
+            memcpy(localCols, all, (pEnd - pStart) * rows * sizeof(int));
+        }
+        MPI_Waitall(numProcs - 1, reqs, MPI_STATUSES_IGNORE);
+    } else {
+        ownedCols(myRank, &pStart, &pEnd);
+        if (toRoot) {
+            MPI_Send(localCols, toCount((pEnd - pStart) * rows), MPI_INT, 0, 2, MPI_COMM_WORLD);
+        } else {
+            MPI_Recv(localCols, toCount((pEnd - pStart) * rows), MPI_INT, 0, 2, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        }
+    }
+    free(reqs);
+}
+
+// A only needs to be valid on rank 0; numThreads is ignored since the
+// parallelism comes from the ranks in MPI_COMM_WORLD
+// 64-bit entry point: r, s and every offset are size_t so n = r * s may exceed 2^31
+void columnSort64(int *A, int numThreads, size_t length, size_t width, double *elapsedTime) {
+    size_t i, j, myStart, myEnd;
+    double start, stop;
+    int *colMajor = NULL;
+
+    MPI_Comm_rank(MPI_COMM_WORLD, &myRank);
+    MPI_Comm_size(MPI_COMM_WORLD, &numProcs);
+    rows = length;
+    cols = width;
+    if (myRank == 0 && columnSortGetEngine() != CS_ENGINE_COLUMNSORT) {
+        fprintf(stderr, "the MPI build only has the columnsort engine; using it instead of %s\n",
+                columnSortEngineName(columnSortGetEngine()));
+    }
+
+    ownedCols(myRank, &myStart, &myEnd);
+    localCols = (int *)malloc((myEnd - myStart) * rows * sizeof(int) + 1);
+
+    // rank 0 lays the row-major input out column major so each rank gets its columns contiguously
+    if (myRank == 0) {
+        colMajor = (int *)malloc(rows * cols * sizeof(int));
+        for (i = 0; i < rows; i++) {
+            for (j = 0; j < cols; j++) {
+                colMajor[j * rows + i] = A[i * cols + j];
+            }
+        }
+    }
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    start = MPI_Wtime();
+
+    exchangeBlocks(colMajor, 0);
+
+    statsBegin(1, NUM_STEPS, stepNames);
+    sortAndTranspose(2);                        // steps 1-2
+    sortAndTranspose(4);                        // steps 3-4
+    double t0 = csNow();
+    columnSortInd(localCols, myEnd - myStart);  // step 5
+    statsAdd(0, 5, csNow() - t0, 0.0, -1, -1);
+    t0 = csNow();
+    shiftMerge();                               // steps 6-8
+    statsAdd(0, 6, csNow() - t0, 0.0, -1, -1);
+
+    // column-major order of the final matrix is the sorted sequence
+    exchangeBlocks(A, 1);
+
+    stop = MPI_Wtime();
+    *elapsedTime = stop - start;
+
+    if (myRank == 0) {
+        free(colMajor);
+    }
+    free(localCols);
+}
+
+void columnSort(int *A, int numThreads, int length, int width, double *elapsedTime) {
+    columnSort64(A, numThreads, (size_t) length, (size_t) width, elapsedTime);
+}
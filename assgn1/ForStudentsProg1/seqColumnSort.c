@@ -3,33 +3,47 @@
 #include <sys/time.h>
 #include <limits.h>
 #include "columnSort.h"
+#include "columnSortHelper.h"
+
+#define NUM_STEPS 8
+
+// names of the steps, for the instrumentation table
+static const char *stepNames[NUM_STEPS] = {
+    "sort", "transpose", "sort", "untranspose", "sort", "shift-forward", "sort", "shift-back"
+};
+static const char *engineStepNames[1] = {"sort"};
+
+// hybrid: steps 1-4, then a multiway merge of the s columns in place of steps 5-8
+#define HYBRID_STEPS 3
+static const char *hybridStepNames[HYBRID_STEPS] = {"sort", "merge-runs", "merge"};
 
 int **matrix;
 int **shiftMatrix;
 
 // use same comparator as driver
 int compareInts(const void *a, const void *b) {
-    return *((int *) a) - *((int *) b);
+    int x = *((int *) a), y = *((int *) b);
+    return (x > y) - (x < y);
 }
 
 // Sort each column in the matrix Individually
-void columnSortInd(int **matrix, int length, int width) {
+void columnSortInd(int **matrix, size_t length, size_t width) {
     // Iterate over each column
     int *tempArray = (int *)malloc(length * sizeof(int));
         if (!tempArray) {
             printf("Memory allocation failed for tempColumn\n");
             return;
         }
-    for (int j = 0; j < width; j++) {
+    for (size_t j = 0; j < width; j++) {
         // Create a temporary array to store the column
-        for (int i = 0; i < length; i++) {
+        for (size_t i = 0; i < length; i++) {
             tempArray[i] = matrix[i][j];
         }
         // Sort each column using qsort
         qsort(tempArray, length, sizeof(int), compareInts);
 
         // Copy the sorted values back to the matrix
-        for (int i = 0; i < length; i++) {
+        for (size_t i = 0; i < length; i++) {
             matrix[i][j] = tempArray[i];
         }
     }
@@ -37,11 +51,11 @@ void columnSortInd(int **matrix, int length, int width) {
 }
 
 // print function to help debug
-void printMatrix(int **matrix, int length, int width) {
-    printf("Matrix (%d x %d):\n", length, width);
-    for (int i = 0; i < length; i++) {
+void printMatrix(int **matrix, size_t length, size_t width) {
+    printf("Matrix (%zu x %zu):\n", length, width);
+    for (size_t i = 0; i < length; i++) {
         
-        for (int j = 0; j < width; j++) {
+        for (size_t j = 0; j < width; j++) {
             printf("%d ", matrix[i][j]);
         }
         printf("\n");
@@ -49,39 +63,19 @@ void printMatrix(int **matrix, int length, int width) {
     printf("\n");
 }
 
-// allocate matrix based on class code 
-int **  allocateMatrix(int rows, int cols) {
-    int i;
-    int *vals, **temp;
-    // allocate values
-    vals = (int *)malloc(rows * cols * sizeof(int));
-    // allocate vector of pointers
-    temp = (int **)malloc(rows * sizeof(int *));
-    for (i = 0; i < rows; i++) {
-        temp[i] = &(vals[i * cols]);
-    }
-    return temp;
-}
-
-// Function to free the matrix memory
-void freeMatrix(int **matrix) {
-    free(matrix[0]);
-    free(matrix);   
-}
-
-int* flatten(int **matrix, int rows, int cols, int step) {
+int* flatten(int **matrix, size_t rows, size_t cols, int step) {
     int *tempArray = (int *)malloc(rows * cols * sizeof(int)); 
-    int index = 0;
+    size_t index = 0;
     if (step == 2) { 
-        for (int a = 0; a < cols; a++) {
-            for (int b = 0; b < rows; b++) {
+        for (size_t a = 0; a < cols; a++) {
+            for (size_t b = 0; b < rows; b++) {
                 tempArray[index++] = matrix[b][a];
             }
         }
     } else {
         // inverted from step 2
-        for (int a = 0; a < rows; a++) {
-            for (int b = 0; b < cols; b++) {
+        for (size_t a = 0; a < rows; a++) {
+            for (size_t b = 0; b < cols; b++) {
                 tempArray[index++] = matrix[a][b];
             }
         }
@@ -89,20 +83,20 @@ int* flatten(int **matrix, int rows, int cols, int step) {
     return tempArray;
 }
 
-void rewrite(int **matrix, int *tempArray, int rows, int cols, int step) {
-    int index;
+void rewrite(int **matrix, int *tempArray, size_t rows, size_t cols, int step) {
+    size_t index;
     if (step == 2) {
         index = 0;
         // rewrite 1d matrix back in row major
-        for (int a = 0; a < rows; a++) {
-            for (int b = 0; b < cols; b++) {
+        for (size_t a = 0; a < rows; a++) {
+            for (size_t b = 0; b < cols; b++) {
                 matrix[a][b] = tempArray[index++];
             }
         }
     } else {
         index = 0;
-        for (int a = 0; a < cols; a++) {
-            for (int b = 0; b < rows; b++) {
+        for (size_t a = 0; a < cols; a++) {
+            for (size_t b = 0; b < rows; b++) {
                 matrix[b][a] = tempArray[index++];
             }
         }
@@ -111,19 +105,19 @@ void rewrite(int **matrix, int *tempArray, int rows, int cols, int step) {
 }
 
 // function following McCann's shift algorithm
-void shiftForward(int **matrix, int **newMatrix, int rows, int cols) {
-    int index;
+void shiftForward(int **matrix, int **newMatrix, size_t rows, size_t cols) {
+    size_t index;
     // Calculate shift value as floor(rows / 2)
-    int shift = rows / 2; // will be floor because int division
+    size_t shift = rows / 2; // will be floor because int division
     int *tempArray = flatten(matrix, rows, cols, 2); // flatten matrix using col major
     index = 0;
     
     // use flattened matrix + padding to make new matrix with shift
     index = 0;
-    for (int a = 0; a < cols+1; a++) {
-        for (int b = 0; b < rows; b++) {
+    for (size_t a = 0; a < cols+1; a++) {
+        for (size_t b = 0; b < rows; b++) {
             if (a == 0 && b < shift) {
-                newMatrix[b][a] = -1; // function only expects non negatives
+                newMatrix[b][a] = INT_MIN; // padding sorts ahead of every real value
             } else if (a == cols && b >= shift) {
                 newMatrix[b][a] = INT_MAX;
             } else {
@@ -136,15 +130,15 @@ void shiftForward(int **matrix, int **newMatrix, int rows, int cols) {
 }
 
 // function following McCann's shift algorithm
-int* shiftBack(int **newMatrix, int rows, int cols) {
-    int index;
+int* shiftBack(int **newMatrix, size_t rows, size_t cols) {
+    size_t index;
     // Calculate shift value as floor(rows / 2)
-    int shift = rows / 2; //will be floor because int division
+    size_t shift = rows / 2; //will be floor because int division
     int *tempArray = (int *)malloc(rows * cols * sizeof(int));
     index = 0;
     // flatten temp matrix ignoring padding
-    for (int a = 0; a < cols; a++) {
-        for (int b = 0; b < rows; b++) {
+    for (size_t a = 0; a < cols; a++) {
+        for (size_t b = 0; b < rows; b++) {
             if ( (a == 0 && b < shift) || (a == cols-1 && b >= shift) ) {
                 continue;
             }
@@ -154,21 +148,103 @@ int* shiftBack(int **newMatrix, int rows, int cols) {
     return tempArray;
 }
 
-void columnSort(int *A, int numThreads, int length, int width, double *elapsedTime) {
+void hybridSort(int *A, size_t length, size_t width, double *elapsedTime) {
+    struct timeval start, stop;
+    size_t *startPos = (size_t *)malloc(2 * width * sizeof(size_t));
+    size_t *endPos = startPos + width;
+    int **runs;
+    double t0 = 0.0;
+
+    if (!startPos) {
+        printf("Memory allocation failed for the merge positions\n");
+        exit(1);
+    }
+    matrixBegin();
+    matrix = allocateMatrix(length, width);
+    runs = allocateMatrix(width, length); // row j holds column j after step 3
+    for (size_t i = 0; i < length; i++) {
+        for (size_t j = 0; j < width; j++) {
+            matrix[i][j] = A[i * width + j];
+        }
+    }
+    int instrument = statsBegin(1, HYBRID_STEPS, hybridStepNames);
+    gettimeofday(&start, NULL);
+    for (int step = 1; step <= HYBRID_STEPS; step++) {
+        if (instrument) {
+            t0 = csNow();
+        }
+        switch (step) {
+            case 1:
+                columnSortInd(matrix, length, width);
+                break;
+            case 2: // steps 2-3
+                for (size_t j = 0; j < width; j++) {
+                    hybridMergeRuns(matrix, length, width, j, runs[j]);
+                }
+                break;
+            case 3: // one thread merges all of A, so it needs no splitters
+                for (size_t j = 0; j < width; j++) {
+                    startPos[j] = 0;
+                    endPos[j] = length;
+                }
+                multiwayMerge(runs, startPos, endPos, (int) width, 1, A);
+                break;
+        }
+        if (instrument) {
+            statsAdd(0, step, csNow() - t0, 0.0, -1, -1);
+        }
+    }
+    gettimeofday(&stop, NULL);
+    *elapsedTime = ((stop.tv_sec - start.tv_sec) * 1000000+(stop.tv_usec-start.tv_usec))/1000000.0;
+    free(startPos);
+    freeMatrix(matrix);
+    freeMatrix(runs);
+}
+
+// 64-bit entry point: r, s and every offset are size_t so n = r * s may exceed 2^31
+void columnSort64(int *A, int numThreads, size_t length, size_t width, double *elapsedTime) {
     int step;
     struct timeval start, stop;
+    (void) numThreads;  // the sequential build always runs on one thread
+
+    // with one thread, sample sort and merge sort both come down to sorting A in one piece
+    if (columnSortGetEngine() == CS_ENGINE_HYBRID) {
+        hybridSort(A, length, width, elapsedTime);
+        return;
+    }
+    if (columnSortGetEngine() != CS_ENGINE_COLUMNSORT) {
+        statsBegin(1, 1, engineStepNames);
+        gettimeofday(&start, NULL);
+        qsort(A, length * width, sizeof(int), compareInts);
+        gettimeofday(&stop, NULL);
+        *elapsedTime = ((stop.tv_sec - start.tv_sec) * 1000000+(stop.tv_usec-start.tv_usec))/1000000.0;
+        statsAdd(0, 1, *elapsedTime, 0.0, -1, -1);
+        return;
+    }
+    matrixBegin();
     matrix = allocateMatrix(length, width); // make the matrix with temp vals
     shiftMatrix = allocateMatrix(length, width+1);// Allocate new matrix with an extra column because of shift
 
     // Copy array values to matrix
-    for (int i = 0; i < length; i++) {
-        for (int j = 0; j < width; j++) {
+    for (size_t i = 0; i < length; i++) {
+        for (size_t j = 0; j < width; j++) {
             matrix[i][j] = A[i * width + j];
         }
     }
+    int instrument = statsBegin(1, NUM_STEPS, stepNames);
+    long long missStart, instrStart, missEnd, instrEnd;
+    perfCounters pc;
+    if (instrument) {
+        perfOpen(&pc);
+    }
     gettimeofday(&start, NULL);
-    int *tempArray;
+    int *tempArray = NULL;
     for (step = 1; step <= 8; step++) {
+        double t0 = 0.0;
+        if (instrument) {
+            perfRead(&pc, &missStart, &instrStart);
+            t0 = csNow();
+        }
         switch(step) {
             case 1:
             case 3:
@@ -200,14 +276,29 @@ void columnSort(int *A, int numThreads, int length, int width, double *elapsedTi
                 exit(0);
                 break;
         }
+        if (instrument) {
+            double t1 = csNow();
+            perfRead(&pc, &missEnd, &instrEnd);
+            statsAdd(0, step, t1 - t0, 0.0,
+                     (missStart < 0) ? -1 : missEnd - missStart,
+                     (instrStart < 0) ? -1 : instrEnd - instrStart);
+        }
     }  
+    if (instrument) {
+        perfClose(&pc);
+    }
     // write final matrix back to 1d array
-    for (int a = 0; a < (length*width); a++) {
+    for (size_t a = 0; a < (length*width); a++) {
         A[a] = tempArray[a]; 
     }
     gettimeofday(&stop, NULL);
     *elapsedTime = ((stop.tv_sec - start.tv_sec) * 1000000+(stop.tv_usec-start.tv_usec))/1000000.0;
+    free(tempArray);
     freeMatrix(matrix);
     freeMatrix(shiftMatrix);
 
-}
\ No newline at end of file
+}
+
+void columnSort(int *A, int numThreads, int length, int width, double *elapsedTime) {
+    columnSort64(A, numThreads, (size_t) length, (size_t) width, elapsedTime);
+}
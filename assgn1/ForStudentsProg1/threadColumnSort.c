@@ -4,21 +4,55 @@
 #include <limits.h>
 #include <pthread.h>
 #include <math.h>
+#include <string.h>
 #include "columnSort.h"
-
-int numThreads, rows, cols;
+#include "columnSortHelper.h"
+
+#define NUM_STEPS 11
+
+// names of the currentStep values, for the instrumentation table
+static const char *stepNames[NUM_STEPS] = {
+    "sort", "transpose-flatten", "transpose-rewrite", "sort", "untranspose-flatten",
+    "untranspose-rewrite", "sort", "shift-flatten", "shift-forward", "sort", "shift-back"
+};
+
+// steps of the sample sort and merge sort engines
+#define SAMPLE_STEPS 5
+#define MERGE_STEPS 2
+#define OVERSAMPLE 32  // samples per thread for choosing sample sort splitters
+
+static const char *sampleStepNames[SAMPLE_STEPS] = {
+    "sample", "splitters", "count", "scatter", "sort-bucket"
+};
+static const char *mergeStepNames[MERGE_STEPS] = {"sort-run", "merge"};
+
+// hybrid columnsort: steps 1-4, then a multiway merge of the s columns in place of steps 5-8
+#define HYBRID_STEPS 4
+static const char *hybridStepNames[HYBRID_STEPS] = {
+    "sort", "merge-runs", "split", "merge"
+};
+
+int numThreads;
+size_t rows, cols;
 int currentStep = 1;
 int **matrix, **shiftMatrix;
-int *finalArr;
+int **runMatrix;  // hybrid only: row j holds column j after step 3
+int *outputArray; // hybrid only: A, which the finish writes into
 volatile int *arrive;  // Dissemination barrier
 
+// shared by the sample sort and merge sort engines
+int *sortInput, *sortBuffer;  // A and a scratch array of the same length
+size_t sortN;
+int *samples, *splitters;     // numThreads * OVERSAMPLE samples, numThreads - 1 splitters
+size_t *bucketCounts;         // [thread][bucket] key counts for sample sort
+
 // dissemination barrier bases on class psuedocode
 void barrier_wait(int id) {
     int logP = ceil(log2(numThreads));
     // Print the arrive array
     // printf("id = %d, logP = %d\n", id, logP);
     // printf("Arrive array: ");
-    // for (int i = 0; i < numThreads; i++) {
+    // for (size_t i = 0; i < numThreads; i++) {
         // printf("%d ", arrive[i]);
     // }
     // printf("\n");
@@ -37,19 +71,20 @@ void barrier_wait(int id) {
 
 // use same comparator as driver
 int compareInts(const void *a, const void *b) {
-    return *((int *) a) - *((int *) b);
+    int x = *((int *) a), y = *((int *) b);
+    return (x > y) - (x < y);
 }
 
 // Sort each column in the matrix Individually
-void columnSortInd(int id, int **matrix, int rows, int cols) {
+void columnSortInd(int id, int **matrix, size_t rows, size_t cols) {
 
     // Compute the number of columns each thread should handle
-    int baseCols = cols / numThreads;
-    int extraCols = cols % numThreads;
+    size_t baseCols = cols / numThreads;
+    size_t extraCols = cols % numThreads;
 
     // Calculate the start and end columns for this thread
-    int startCol, endCol;
-    if (id < extraCols) {
+    size_t startCol, endCol;
+    if ((size_t) id < extraCols) {
         startCol = id * (baseCols + 1);
         endCol = startCol + baseCols + 1;
     } else {
@@ -66,51 +101,28 @@ void columnSortInd(int id, int **matrix, int rows, int cols) {
             printf("Memory allocation failed for tempColumn\n");
             return;
         }
-    for (int j = startCol; j < endCol; j++) {
+    for (size_t j = startCol; j < endCol; j++) {
         // Create a temporary array to store the column
-        for (int i = 0; i < rows; i++) {
+        for (size_t i = 0; i < rows; i++) {
             tempArray[i] = matrix[i][j];
         }
         // Sort each column using qsort
         qsort(tempArray, rows, sizeof(int), compareInts);
 
         // Copy the sorted values back to the matrix
-        for (int i = 0; i < rows; i++) {
+        for (size_t i = 0; i < rows; i++) {
             matrix[i][j] = tempArray[i];
         }
     }
     free(tempArray);
 }
-// allocate matrix based on class code 
-int **allocateMatrix(int rows, int cols) {
-    int i;
-    int *vals, **temp;
-    // allocate values
-    vals = (int *)malloc(rows * cols * sizeof(int));
-    for (i = 0; i < rows * cols; i++) {
-        vals[i] = -1;
-    }
-    // allocate vector of pointers
-    temp = (int **)malloc(rows * sizeof(int *));
-    for (i = 0; i < rows; i++) {
-        temp[i] = &(vals[i * cols]);
-    }
-    return temp;
-}
-
-// Function to free the matrix memory
-void freeMatrix(int **matrix) {
-    free(matrix[0]);
-    free(matrix);   
-}
-
-int* flatten(int **matrix, int id, int rows, int cols, int step) {
-    int baseCols = cols / numThreads;
-    int extraCols = cols % numThreads;
+int* flatten(int **matrix, int id, size_t rows, size_t cols, int step) {
+    size_t baseCols = cols / numThreads;
+    size_t extraCols = cols % numThreads;
 
     // Calculate the start and end columns for this thread
-    int startCol, endCol;
-    if (id < extraCols) {
+    size_t startCol, endCol;
+    if ((size_t) id < extraCols) {
         startCol = id * (baseCols + 1);
         endCol = startCol + baseCols + 1;
     } else {
@@ -118,20 +130,20 @@ int* flatten(int **matrix, int id, int rows, int cols, int step) {
         endCol = startCol + baseCols;
     }
     int *tempArray = (int *)malloc( (rows*(endCol-startCol) )* sizeof(int)); 
-    int index = 0;
+    size_t index = 0;
     if (step == 2) { 
-        for (int a = startCol; a < endCol; a++) {
-            for (int b = 0; b < rows; b++) {
+        for (size_t a = startCol; a < endCol; a++) {
+            for (size_t b = 0; b < rows; b++) {
                 tempArray[index++] = matrix[b][a];
             }
         }
     } else {
-        int rowsPerCol = rows / cols;
-        int startRow = startCol * rowsPerCol;
-        int endRow = endCol * rowsPerCol;
+        size_t rowsPerCol = rows / cols;
+        size_t startRow = startCol * rowsPerCol;
+        size_t endRow = endCol * rowsPerCol;
         // inverted from step 2
-        for (int a = startRow; a < endRow; a++) {
-            for (int b = 0; b < cols; b++) {
+        for (size_t a = startRow; a < endRow; a++) {
+            for (size_t b = 0; b < cols; b++) {
                 tempArray[index++] = matrix[a][b];
             }
         }
@@ -139,12 +151,12 @@ int* flatten(int **matrix, int id, int rows, int cols, int step) {
     return tempArray;
 }
 
-void rewrite(int **matrix, int id, int *tempArray, int rows, int cols, int step) {
-    int index;
-    int startCol, endCol;
-    int baseCols = cols / numThreads;
-    int extraCols = cols % numThreads;
-    if (id < extraCols) {
+void rewrite(int **matrix, int id, int *tempArray, size_t rows, size_t cols, int step) {
+    size_t index;
+    size_t startCol, endCol;
+    size_t baseCols = cols / numThreads;
+    size_t extraCols = cols % numThreads;
+    if ((size_t) id < extraCols) {
         startCol = id * (baseCols + 1);
         endCol = startCol + baseCols + 1;
     } else {
@@ -152,22 +164,22 @@ void rewrite(int **matrix, int id, int *tempArray, int rows, int cols, int step)
         endCol = startCol + baseCols;
     }
 
-    int rowsPerCol = rows / cols;
-    int startRow = startCol * rowsPerCol;
-    int endRow = endCol * rowsPerCol;
+    size_t rowsPerCol = rows / cols;
+    size_t startRow = startCol * rowsPerCol;
+    size_t endRow = endCol * rowsPerCol;
 
     if (step == 2) {
         index = 0;
         // rewrite 1d matrix back in row major
-        for (int a = startRow; a < endRow; a++) {
-            for (int b = 0; b < cols; b++) {
+        for (size_t a = startRow; a < endRow; a++) {
+            for (size_t b = 0; b < cols; b++) {
                 matrix[a][b] = tempArray[index++];
             }
         }
     } else {
         index = 0;
-        for (int a = startCol; a < endCol; a++) {
-            for (int b = 0; b < rows; b++) {
+        for (size_t a = startCol; a < endCol; a++) {
+            for (size_t b = 0; b < rows; b++) {
                 matrix[b][a] = tempArray[index++];
             }
         }
@@ -175,18 +187,18 @@ void rewrite(int **matrix, int id, int *tempArray, int rows, int cols, int step)
 }
 
 // function following McCann's column major transpose for non-square matrix
-void transpose(int id, int **matrix, int rows, int cols, int step) {
+void transpose(int id, int **matrix, size_t rows, size_t cols, int step) {
     
     int *tempArray = (int *)malloc(rows * cols * sizeof(int)); 
-    int index = 0;
+    size_t index = 0;
 
     // Compute the number of columns each thread should handle
-    int baseCols = cols / numThreads;
-    int extraCols = cols % numThreads;
+    size_t baseCols = cols / numThreads;
+    size_t extraCols = cols % numThreads;
 
     // Calculate the start and end columns for this thread
-    int startCol, endCol;
-    if (id < extraCols) {
+    size_t startCol, endCol;
+    if ((size_t) id < extraCols) {
         startCol = id * (baseCols + 1);
         endCol = startCol + baseCols + 1;
     } else {
@@ -194,37 +206,37 @@ void transpose(int id, int **matrix, int rows, int cols, int step) {
         endCol = startCol + baseCols;
     }
 
-    int rowsPerCol = rows / cols;
-    int startRow = startCol * rowsPerCol;
-    int endRow = endCol * rowsPerCol;
+    size_t rowsPerCol = rows / cols;
+    size_t startRow = startCol * rowsPerCol;
+    size_t endRow = endCol * rowsPerCol;
     
     // step 2 calls for columns to rows
     // flatten matrix to 1d
     if (step == 2) { 
-        for (int a = startCol; a < endCol; a++) {
-            for (int b = 0; b < rows; b++) {
+        for (size_t a = startCol; a < endCol; a++) {
+            for (size_t b = 0; b < rows; b++) {
                 tempArray[index++] = matrix[b][a];
             }
         }
         barrier_wait(id);
         index = 0;
         // rewrite 1d matrix back in row major
-        for (int a = startRow; a < endRow; a++) {
-            for (int b = 0; b < cols; b++) {
+        for (size_t a = startRow; a < endRow; a++) {
+            for (size_t b = 0; b < cols; b++) {
                 matrix[a][b] = tempArray[index++];
             }
         }
     // step 4 calls for rows to columns
     } else {
         // inverted from step 2
-        for (int a = 0; a < rows; a++) {
-            for (int b = 0; b < cols; b++) {
+        for (size_t a = 0; a < rows; a++) {
+            for (size_t b = 0; b < cols; b++) {
                 tempArray[index++] = matrix[a][b];
             }
         }
         index = 0;
-        for (int a = 0; a < cols; a++) {
-            for (int b = 0; b < rows; b++) {
+        for (size_t a = 0; a < cols; a++) {
+            for (size_t b = 0; b < rows; b++) {
                 matrix[b][a] = tempArray[index++];
             }
         }
@@ -232,14 +244,14 @@ void transpose(int id, int **matrix, int rows, int cols, int step) {
 }
 
 // function following McCann's shift algorithm
-void shiftForward(int **newMatrix, int *tempArray, int id, int rows, int cols) {
-    int b;
-    int baseCols = cols / numThreads;
-    int extraCols = cols % numThreads;
+void shiftForward(int **newMatrix, int *tempArray, int id, size_t rows, size_t cols) {
+    size_t b;
+    size_t baseCols = cols / numThreads;
+    size_t extraCols = cols % numThreads;
 
     // Calculate the start and end columns for this thread
-    int startCol, endCol;
-    if (id < extraCols) {
+    size_t startCol, endCol;
+    if ((size_t) id < extraCols) {
         startCol = id * (baseCols + 1);
         endCol = startCol + baseCols + 1;
     } else {
@@ -248,15 +260,21 @@ void shiftForward(int **newMatrix, int *tempArray, int id, int rows, int cols) {
     }
 
     endCol++;
-    int index;
+    size_t index;
     // Calculate shift value as floor(rows / 2)
-    int shift = rows / 2; // will be floor because int division
+    size_t shift = rows / 2; // will be floor because int division
     // use flattened matrix + padding to make new matrix with shift
+    // the top of column 0 is padding that must sort ahead of every real value
+    if (startCol == 0) {
+        for (b = 0; b < shift; b++) {
+            newMatrix[b][0] = INT_MIN;
+        }
+    }
     index = 0;
-    for (int a = startCol; a < endCol; a++) {
-        int startRow = (a == startCol) ? shift : 0;  // Start at shift for the first column, otherwise 0
-        int endRow = (a == cols) ? rows : ((a == endCol - 1) ? shift : rows); // end at shift or write through
-        for (int b = startRow; b < endRow; b++) {
+    for (size_t a = startCol; a < endCol; a++) {
+        size_t startRow = (a == startCol) ? shift : 0;  // Start at shift for the first column, otherwise 0
+        size_t endRow = (a == cols) ? rows : ((a == endCol - 1) ? shift : rows); // end at shift or write through
+        for (size_t b = startRow; b < endRow; b++) {
             if (a == cols && b >= shift) {
                 newMatrix[b][a] = INT_MAX;
             } else {
@@ -268,14 +286,14 @@ void shiftForward(int **newMatrix, int *tempArray, int id, int rows, int cols) {
 }
 
 // function following McCann's shift algorithm
-void shiftBack(int **newMatrix, int *arr, int rows, int cols) {
-    int index;
+void shiftBack(int **newMatrix, int *arr, size_t rows, size_t cols) {
+    size_t index;
     // Calculate shift value as floor(rows / 2)
-    int shift = rows / 2; //will be floor because int division
+    size_t shift = rows / 2; //will be floor because int division
     index = 0;
     // flatten temp matrix ignoring padding
-    for (int a = 0; a < cols; a++) {
-        for (int b = 0; b < rows; b++) {
+    for (size_t a = 0; a < cols; a++) {
+        for (size_t b = 0; b < rows; b++) {
             if ( (a == 0 && b < shift) || (a == cols-1 && b >= shift) ) {
                 continue;
             }
@@ -285,11 +303,11 @@ void shiftBack(int **newMatrix, int *arr, int rows, int cols) {
 }
 
 // print function to help debug
-void printMatrix(int **matrix, int id, int length, int width) {
-    printf("Step %d id %d Matrix (%d x %d):\n", currentStep, id, length, width);
-    for (int i = 0; i < length; i++) {
+void printMatrix(int **matrix, int id, size_t length, size_t width) {
+    printf("Step %d id %d Matrix (%zu x %zu):\n", currentStep, id, length, width);
+    for (size_t i = 0; i < length; i++) {
         
-        for (int j = 0; j < width; j++) {
+        for (size_t j = 0; j < width; j++) {
             printf("%d ", matrix[i][j]);
         }
         printf("\n");
@@ -299,8 +317,21 @@ void printMatrix(int **matrix, int id, int length, int width) {
 
 void *worker(void *arg) {
     int id = *((int *) arg);
-    int *tempArray;
+    int *tempArray = NULL;
+    int instrument = statsOn();
+    double t0, t1;
+    long long missStart, instrStart, missEnd, instrEnd;
+    perfCounters pc;
+
+    if (instrument) {
+        perfOpen(&pc);
+    }
     while (currentStep <= 10) {
+        int step = currentStep;
+        if (instrument) {
+            perfRead(&pc, &missStart, &instrStart);
+            t0 = csNow();
+        }
         switch (currentStep) {
             case 1: // step 1
             case 4: // step 3
@@ -330,29 +361,374 @@ void *worker(void *arg) {
                 printf("Unknown step: %d\n", currentStep);
                 break;
         }
+        if (instrument) {
+            t1 = csNow();
+            perfRead(&pc, &missEnd, &instrEnd);
+        }
         barrier_wait(id); // Synchronize all threads
         if (id == 0) { 
             currentStep++; 
         } // Move to next step only after all threads finish 
         barrier_wait(id); // Synchronize all threads  
+        if (instrument) {
+            statsAdd(id, step, t1 - t0, csNow() - t1,
+                     (missStart < 0) ? -1 : missEnd - missStart,
+                     (instrStart < 0) ? -1 : instrEnd - instrStart);
+        }
+    }
+    if (instrument) {
+        perfClose(&pc);
     }
     return NULL;
 }
 
-void columnSort(int *A, int threads, int length, int width, double *elapsedTime) {
+// per-thread timing of one engine step, recorded through statsAdd like worker() does
+typedef struct stepTimer {
+    int instrument;
+    perfCounters pc;
+    double t0;
+    long long missStart, instrStart;
+} stepTimer;
+
+void stepBegin(stepTimer *st) {
+    if (st->instrument) {
+        perfRead(&st->pc, &st->missStart, &st->instrStart);
+        st->t0 = csNow();
+    }
+}
+
+// finish a step: every thread waits at the barrier before any starts the next one
+void stepEnd(stepTimer *st, int id, int step) {
+    double t1 = 0.0;
+    long long missEnd, instrEnd;
+    if (st->instrument) {
+        t1 = csNow();
+        perfRead(&st->pc, &missEnd, &instrEnd);
+    }
+    barrier_wait(id);
+    if (st->instrument) {
+        statsAdd(id, step, t1 - st->t0, csNow() - t1,
+                 (st->missStart < 0) ? -1 : missEnd - st->missStart,
+                 (st->instrStart < 0) ? -1 : instrEnd - st->instrStart);
+    }
+}
+
+// keys [lo, hi) of an n-key array that thread id works on
+void chunkRange(int id, size_t n, size_t *lo, size_t *hi) {
+    *lo = n * id / numThreads;
+    *hi = n * (id + 1) / numThreads;
+}
+
+// number of the sorted samples below v, or with inclusive, at most v
+int samplesBelow(int v, int inclusive) {
+    int lo = 0, hi = numThreads * OVERSAMPLE;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (samples[mid] < v || (inclusive && samples[mid] == v)) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+// bucket of the key v at index i: the number of splitters <= v. A key equal to a
+// splitter may go to any bucket that splitter bounds, so such keys are shared out the
+// way the samples equal to v are (sample x lands in bucket x / OVERSAMPLE), choosing by
+// index; otherwise every copy of a common key would land in one bucket
+int findBucket(int v, size_t i) {
+    int lo = 0, hi = numThreads - 1, first, last, bucket;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (splitters[mid] <= v) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo == 0 || splitters[lo - 1] != v) {
+        return lo;
+    }
+    first = samplesBelow(v, 0);
+    last = samplesBelow(v, 1);
+    bucket = (first + (int) (i % (size_t) (last - first))) / OVERSAMPLE;
+    return (bucket < lo) ? bucket : lo;
+}
+
+void *sampleSortWorker(void *arg) {
+    int id = *((int *) arg);
+    size_t lo, hi, i, start = 0, total = 0;
+    size_t *offsets = (size_t *)malloc(numThreads * sizeof(size_t));
+    size_t *counts = &bucketCounts[id * numThreads];
+    stepTimer st;
+    int b, t;
+
+    if (!offsets) {
+        printf("Memory allocation failed for offsets\n");
+        exit(1);
+    }
+    st.instrument = statsOn();
+    if (st.instrument) {
+        perfOpen(&st.pc);
+    }
+    chunkRange(id, sortN, &lo, &hi);
+
+    // step 1: regularly spaced samples of this thread's keys
+    stepBegin(&st);
+    for (i = 0; i < OVERSAMPLE; i++) {
+        samples[id * OVERSAMPLE + i] = (hi > lo) ? sortInput[lo + (hi - lo) * i / OVERSAMPLE] : INT_MAX;
+    }
+    stepEnd(&st, id, 1);
+
+    // step 2: thread 0 sorts the samples and keeps every OVERSAMPLE-th as a splitter
+    stepBegin(&st);
+    if (id == 0) {
+        qsort(samples, numThreads * OVERSAMPLE, sizeof(int), compareInts);
+        for (b = 1; b < numThreads; b++) {
+            splitters[b - 1] = samples[b * OVERSAMPLE];
+        }
+    }
+    stepEnd(&st, id, 2);
+
+    // step 3: count this thread's keys per bucket
+    stepBegin(&st);
+    for (b = 0; b < numThreads; b++) {
+        counts[b] = 0;
+    }
+    for (i = lo; i < hi; i++) {
+        counts[findBucket(sortInput[i], i)]++;
+    }
+    stepEnd(&st, id, 3);
+
+    // step 4: scatter into the buffer; bucket b is contiguous, holding each thread's keys in id order
+    stepBegin(&st);
+    for (b = 0; b < numThreads; b++) {
+        offsets[b] = total;
+        for (t = 0; t < numThreads; t++) {
+            if (t < id) {
+                offsets[b] += bucketCounts[t * numThreads + b];
+            }
+            total += bucketCounts[t * numThreads + b];
+        }
+        if (b < id) {
+            start = total;
+        }
+    }
+    for (i = lo; i < hi; i++) {
+        sortBuffer[offsets[findBucket(sortInput[i], i)]++] = sortInput[i];
+    }
+    stepEnd(&st, id, 4);
+
+    // step 5: sort bucket id, which lands at the same offsets in A
+    stepBegin(&st);
+    total = 0;
+    for (t = 0; t < numThreads; t++) {
+        total += bucketCounts[t * numThreads + id];
+    }
+    qsort(sortBuffer + start, total, sizeof(int), compareInts);
+    memcpy(sortInput + start, sortBuffer + start, total * sizeof(int));
+    stepEnd(&st, id, 5);
+
+    if (st.instrument) {
+        perfClose(&st.pc);
+    }
+    free(offsets);
+    return NULL;
+}
+
+void *mergeSortWorker(void *arg) {
+    int id = *((int *) arg);
+    size_t lo, hi;
+    int **runs = (int **)malloc(numThreads * sizeof(int *));
+    size_t *lengths = (size_t *)malloc(3 * numThreads * sizeof(size_t));
+    size_t *startPos = lengths + numThreads, *endPos = startPos + numThreads;
+    stepTimer st;
+    int t;
+
+    if (!runs || !lengths) {
+        printf("Memory allocation failed for runs\n");
+        exit(1);
+    }
+    st.instrument = statsOn();
+    if (st.instrument) {
+        perfOpen(&st.pc);
+    }
+    chunkRange(id, sortN, &lo, &hi);
+
+    // step 1: sort this thread's keys into the buffer as one run
+    stepBegin(&st);
+    memcpy(sortBuffer + lo, sortInput + lo, (hi - lo) * sizeof(int));
+    qsort(sortBuffer + lo, hi - lo, sizeof(int), compareInts);
+    stepEnd(&st, id, 1);
+
+    // step 2: merge output keys [lo, hi) from every run straight into A
+    stepBegin(&st);
+    for (t = 0; t < numThreads; t++) {
+        size_t runLo, runHi;
+        chunkRange(t, sortN, &runLo, &runHi);
+        runs[t] = sortBuffer + runLo;
+        lengths[t] = runHi - runLo;
+    }
+    multiwaySplit(runs, lengths, numThreads, 1, lo, startPos);
+    multiwaySplit(runs, lengths, numThreads, 1, hi, endPos);
+    multiwayMerge(runs, startPos, endPos, numThreads, 1, sortInput + lo);
+    stepEnd(&st, id, 2);
+
+    if (st.instrument) {
+        perfClose(&st.pc);
+    }
+    free(runs);
+    free(lengths);
+    return NULL;
+}
+
+// the columns thread id owns, split the same way as in columnSortInd
+void ownedCols(int id, size_t *startCol, size_t *endCol) {
+    size_t baseCols = cols / numThreads;
+    size_t extraCols = cols % numThreads;
+    if ((size_t) id < extraCols) {
+        *startCol = id * (baseCols + 1);
+        *endCol = *startCol + baseCols + 1;
+    } else {
+        *startCol = id * baseCols + extraCols;
+        *endCol = *startCol + baseCols;
+    }
+}
+
+// the hybrid: step 1, steps 2-3 as merges of each transposed column's sorted runs into
+// runMatrix, then in place of steps 4-8 each thread merges an equal, contiguous share of
+// A from the s sorted columns, between splitters it finds itself
+void *hybridWorker(void *arg) {
+    int id = *((int *) arg);
+    size_t j, startCol, endCol, lo, hi;
+    size_t *startPos = (size_t *)malloc(2 * cols * sizeof(size_t));
+    size_t *endPos = startPos + cols;
+    stepTimer st;
+
+    if (!startPos) {
+        printf("Memory allocation failed for the split positions\n");
+        exit(1);
+    }
+    st.instrument = statsOn();
+    if (st.instrument) {
+        perfOpen(&st.pc);
+    }
+    ownedCols(id, &startCol, &endCol);
+    chunkRange(id, rows * cols, &lo, &hi);
+
+    stepBegin(&st);
+    columnSortInd(id, matrix, rows, cols);
+    stepEnd(&st, id, 1);
+
+    // steps 2-3
+    stepBegin(&st);
+    for (j = startCol; j < endCol; j++) {
+        hybridMergeRuns(matrix, rows, cols, j, runMatrix[j]);
+    }
+    stepEnd(&st, id, 2);
+
+    stepBegin(&st);
+    hybridSplit(runMatrix, rows, cols, lo, startPos);
+    hybridSplit(runMatrix, rows, cols, hi, endPos);
+    stepEnd(&st, id, 3);
+
+    stepBegin(&st);
+    multiwayMerge(runMatrix, startPos, endPos, (int) cols, 1, outputArray + lo);
+    stepEnd(&st, id, 4);
+
+    if (st.instrument) {
+        perfClose(&st.pc);
+    }
+    free(startPos);
+    return NULL;
+}
+
+// thread pool shared by every engine: run fn on threads 0 .. numThreads-1 and wait for them
+void runWorkers(void *(*fn)(void *)) {
     int i;
-    int *params;
+    pthread_t *threadHandles = (pthread_t *)malloc(numThreads * sizeof(pthread_t));
+    int *params = (int *)malloc(numThreads * sizeof(int));
+    if (!threadHandles || !params) {
+        printf("Memory allocation failed for threads\n");
+        exit(1);
+    }
+    for (i = 0; i < numThreads; i++) {
+        params[i] = i;
+        pthread_create(&threadHandles[i], NULL, fn, (void *)&params[i]);
+    }
+    for (i = 0; i < numThreads; i++) {
+        pthread_join(threadHandles[i], NULL);
+    }
+    free(params);
+    free(threadHandles);
+}
+
+// sample sort and merge sort work on A directly with one scratch array, a 1 x n matrix so
+// that it is allocated (and counted in columnSortHugePages) like the columnsort matrices
+void engineSort(int *A, int engine, double *elapsedTime) {
+    struct timeval start, stop;
+    int **bufferMatrix;
+    sortInput = A;
+    sortN = rows * cols;
+    matrixBegin();
+    bufferMatrix = allocateMatrix(1, sortN);
+    sortBuffer = bufferMatrix[0];
+    samples = (int *)malloc(numThreads * OVERSAMPLE * sizeof(int));
+    splitters = (int *)malloc(numThreads * sizeof(int));
+    bucketCounts = (size_t *)malloc((size_t) numThreads * numThreads * sizeof(size_t));
+    if (!samples || !splitters || !bucketCounts) {
+        printf("Memory allocation failed for the %s buffers\n", columnSortEngineName(engine));
+        exit(1);
+    }
+    if (engine == CS_ENGINE_SAMPLESORT) {
+        statsBegin(numThreads, SAMPLE_STEPS, sampleStepNames);
+    } else {
+        statsBegin(numThreads, MERGE_STEPS, mergeStepNames);
+    }
+
+    gettimeofday(&start, NULL);
+    runWorkers((engine == CS_ENGINE_SAMPLESORT) ? sampleSortWorker : mergeSortWorker);
+    gettimeofday(&stop, NULL);
+    *elapsedTime = ((stop.tv_sec - start.tv_sec) * 1000000+(stop.tv_usec-start.tv_usec))/1000000.0;
+
+    freeMatrix(bufferMatrix);
+    free(samples);
+    free(splitters);
+    free(bucketCounts);
+}
+
+// 64-bit entry point: r, s and every offset are size_t so n = r * s may exceed 2^31
+void columnSort64(int *A, int threads, size_t length, size_t width, double *elapsedTime) {
+    int i;
+    int engine = columnSortGetEngine();
     numThreads = threads;
+    currentStep = 1;
     rows = length;
     cols = width; 
     struct timeval start, stop;
+
+    if (engine == CS_ENGINE_SAMPLESORT || engine == CS_ENGINE_MERGESORT) {
+        arrive = (volatile int*)calloc(numThreads, sizeof(int));
+        if (!arrive) {
+            printf("Memory allocation failed for arrive\n");
+            exit(1);
+        }
+        engineSort(A, engine, elapsedTime);
+        free((void *)arrive);
+        return;
+    }
+    matrixBegin();
     matrix = allocateMatrix(length, width); // make the matrix with temp vals
-    shiftMatrix = allocateMatrix(length, width+1);// Allocate new matrix with an extra column because of shift
-    finalArr = (int *)malloc(rows * cols * sizeof(int));
+    if (engine == CS_ENGINE_HYBRID) {
+        runMatrix = allocateMatrix(width, length); // one row per sorted column
+    } else {
+        shiftMatrix = allocateMatrix(length, width+1);// Allocate new matrix with an extra column because of shift
+    }
 
     // Copy array values to matrix
-    for (i = 0; i < length; i++) {
-        for (int j = 0; j < width; j++) {
+    for (size_t i = 0; i < length; i++) {
+        for (size_t j = 0; j < width; j++) {
             matrix[i][j] = A[i * width + j];
         }
     }
@@ -362,32 +738,37 @@ void columnSort(int *A, int threads, int length, int width, double *elapsedTime)
         printf("Memory allocation failed for arrive\n");
         exit(1);
     }
-    for (int i = 0; i < numThreads; i++) {
+    for (i = 0; i < numThreads; i++) {
         arrive[i] = 0;
     }
+    if (engine == CS_ENGINE_HYBRID) {
+        statsBegin(numThreads, HYBRID_STEPS, hybridStepNames);
+    } else {
+        statsBegin(numThreads, NUM_STEPS, stepNames);
+    }
 
     
     gettimeofday(&start, NULL);
 
-    // Allocate thread handles
-    pthread_t *threadHandles = (pthread_t *)malloc(numThreads * sizeof(pthread_t));
-    params = (int *)malloc(numThreads * sizeof(int));
-    //create threads
-    for (i = 0; i < numThreads; i++) {
-        params[i] = i;
-        pthread_create(&threadHandles[i], NULL, worker, (void *)&params[i]);
-    }
-    for (i = 0; i < numThreads; i++) {
-        pthread_join(threadHandles[i], NULL);
-    }
+    if (engine == CS_ENGINE_HYBRID) {
+        outputArray = A;
+        runWorkers(hybridWorker);
+    } else {
+        runWorkers(worker);
 
-    shiftBack(shiftMatrix, A, rows, cols+1); 
+        double t0 = csNow();
+        shiftBack(shiftMatrix, A, rows, cols+1); 
+        statsAdd(0, NUM_STEPS, csNow() - t0, 0.0, -1, -1);
+    }
     gettimeofday(&stop, NULL);
     *elapsedTime = ((stop.tv_sec - start.tv_sec) * 1000000+(stop.tv_usec-start.tv_usec))/1000000.0;
-    free(params);
 
     free((void *)arrive);
     freeMatrix(matrix);
-    freeMatrix(shiftMatrix);
+    freeMatrix((engine == CS_ENGINE_HYBRID) ? runMatrix : shiftMatrix);
+
+}
 
+void columnSort(int *A, int threads, int length, int width, double *elapsedTime) {
+    columnSort64(A, threads, (size_t) length, (size_t) width, elapsedTime);
 }
\ No newline at end of file